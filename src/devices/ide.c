@@ -34,6 +34,7 @@
 #define STA_BSY 0x80            /* Busy. */
 #define STA_DRDY 0x40           /* Device Ready. */
 #define STA_DRQ 0x08            /* Data Request. */
+#define STA_ERR 0x01            /* Error. */
 
 /* Control Register bits. */
 #define CTL_SRST 0x04           /* Software Reset. */
@@ -49,6 +50,12 @@
 #define CMD_IDENTIFY_DEVICE 0xec        /* IDENTIFY DEVICE. */
 #define CMD_READ_SECTOR_RETRY 0x20      /* READ SECTOR with retries. */
 #define CMD_WRITE_SECTOR_RETRY 0x30     /* WRITE SECTOR with retries. */
+#define CMD_READ_MULTIPLE 0xc4          /* READ MULTIPLE. */
+#define CMD_WRITE_MULTIPLE 0xc5         /* WRITE MULTIPLE. */
+#define CMD_SET_MULTIPLE_MODE 0xc6      /* SET MULTIPLE MODE. */
+
+/* Most sectors one READ or WRITE command can transfer. */
+#define MAX_TRANSFER_SECTORS 256
 
 /* An ATA device. */
 struct ata_disk
@@ -57,6 +64,9 @@ struct ata_disk
     struct channel *channel;    /* Channel that disk is attached to. */
     int dev_no;                 /* Device 0 or 1 for master or slave. */
     bool is_ata;                /* Is device an ATA disk? */
+    int multiple;               /* Sectors per interrupt with READ and
+                                   WRITE MULTIPLE, or 0 to use READ and
+                                   WRITE SECTOR instead. */
   };
 
 /* An ATA channel (aka controller).
@@ -84,8 +94,9 @@ static struct block_operations ide_operations;
 static void reset_channel (struct channel *);
 static bool check_device_type (struct ata_disk *);
 static void identify_ata_device (struct ata_disk *);
+static bool set_multiple_mode (struct ata_disk *, int sectors);
 
-static void select_sector (struct ata_disk *, block_sector_t);
+static void select_sector (struct ata_disk *, block_sector_t, size_t cnt);
 static void issue_pio_command (struct channel *, uint8_t command);
 static void input_sector (struct channel *, void *);
 static void output_sector (struct channel *, const void *);
@@ -136,6 +147,7 @@ ide_init (void)
           d->channel = c;
           d->dev_no = dev_no;
           d->is_ata = false;
+          d->multiple = 0;
         }
 
       /* Register interrupt handler. */
@@ -265,6 +277,7 @@ identify_ata_device (struct ata_disk *d)
   char *model, *serial;
   char extra_info[128];
   struct block *block;
+  int multiple;
 
   ASSERT (d->is_ata);
 
@@ -303,12 +316,35 @@ identify_ata_device (struct ata_disk *d)
       return;
     }
 
+  /* Have the disk interrupt once per group of as many sectors as
+     it allows in a multi-sector transfer, rather than once per
+     sector. */
+  multiple = *(uint16_t *) &id[47 * 2] & 0xff;
+  if (multiple > 1 && set_multiple_mode (d, multiple))
+    d->multiple = multiple;
+
   /* Register. */
   block = block_register (d->name, BLOCK_RAW, extra_info, capacity,
                           &ide_operations, d);
   partition_scan (block);
 }
 
+/* Sends a SET MULTIPLE MODE command to disk D, so that READ and
+   WRITE MULTIPLE transfer SECTORS sectors per interrupt.  Returns
+   true if successful, false if the disk rejected it. */
+static bool
+set_multiple_mode (struct ata_disk *d, int sectors) 
+{
+  struct channel *c = d->channel;
+
+  select_device_wait (d);
+  outb (reg_nsect (c), sectors);
+  issue_pio_command (c, CMD_SET_MULTIPLE_MODE);
+  sema_down (&c->completion_wait);
+  wait_while_busy (d);
+  return (inb (reg_alt_status (c)) & STA_ERR) == 0;
+}
+
 /* Translates STRING, which consists of SIZE bytes in a funky
    format, into a null-terminated string in-place.  Drops
    trailing whitespace and null bytes.  Returns STRING.  */
@@ -337,63 +373,136 @@ descramble_ata_string (char *string, int size)
   return string;
 }
 
-/* Reads sector SEC_NO from disk D into BUFFER, which must have
-   room for BLOCK_SECTOR_SIZE bytes.
+/* Reads the CNT sectors starting at SEC_NO from disk D into
+   BUFFERS, one sector per buffer, with as few commands as
+   possible.  The disk interrupts once per sector, or once per
+   D->multiple sectors if it supports READ MULTIPLE.
    Internally synchronizes accesses to disks, so external
    per-disk locking is unneeded. */
 static void
-ide_read (void *d_, block_sector_t sec_no, void *buffer)
+ide_read_multiple (void *d_, block_sector_t sec_no, size_t cnt,
+                   void *const buffers[])
 {
   struct ata_disk *d = d_;
   struct channel *c = d->channel;
+  size_t block = d->multiple > 0 ? d->multiple : 1;
+
   lock_acquire (&c->lock);
-  select_sector (d, sec_no);
-  issue_pio_command (c, CMD_READ_SECTOR_RETRY);
-  sema_down (&c->completion_wait);
-  if (!wait_while_busy (d))
-    PANIC ("%s: disk read failed, sector=%"PRDSNu, d->name, sec_no);
-  input_sector (c, buffer);
+  while (cnt > 0)
+    {
+      size_t n = cnt < MAX_TRANSFER_SECTORS ? cnt : MAX_TRANSFER_SECTORS;
+      size_t i;
+
+      select_sector (d, sec_no, n);
+      issue_pio_command (c, (d->multiple > 0 ? CMD_READ_MULTIPLE
+                             : CMD_READ_SECTOR_RETRY));
+      for (i = 0; i < n; i++)
+        {
+          if (i % block == 0)
+            {
+              sema_down (&c->completion_wait);
+              if (!wait_while_busy (d))
+                PANIC ("%s: disk read failed, sector=%"PRDSNu,
+                       d->name, sec_no + i);
+            }
+          input_sector (c, buffers[i]);
+        }
+
+      sec_no += n;
+      buffers += n;
+      cnt -= n;
+    }
   lock_release (&c->lock);
 }
 
-/* Write sector SEC_NO to disk D from BUFFER, which must contain
-   BLOCK_SECTOR_SIZE bytes.  Returns after the disk has
-   acknowledged receiving the data.
+/* Writes the CNT sectors starting at SEC_NO to disk D from
+   BUFFERS, one sector per buffer, with as few commands as
+   possible.  Returns after the disk has acknowledged receiving
+   the data.
    Internally synchronizes accesses to disks, so external
    per-disk locking is unneeded. */
 static void
-ide_write (void *d_, block_sector_t sec_no, const void *buffer)
+ide_write_multiple (void *d_, block_sector_t sec_no, size_t cnt,
+                    const void *const buffers[])
 {
   struct ata_disk *d = d_;
   struct channel *c = d->channel;
+  size_t block = d->multiple > 0 ? d->multiple : 1;
+
   lock_acquire (&c->lock);
-  select_sector (d, sec_no);
-  issue_pio_command (c, CMD_WRITE_SECTOR_RETRY);
-  if (!wait_while_busy (d))
-    PANIC ("%s: disk write failed, sector=%"PRDSNu, d->name, sec_no);
-  output_sector (c, buffer);
-  sema_down (&c->completion_wait);
+  while (cnt > 0)
+    {
+      size_t n = cnt < MAX_TRANSFER_SECTORS ? cnt : MAX_TRANSFER_SECTORS;
+      size_t i;
+
+      select_sector (d, sec_no, n);
+      issue_pio_command (c, (d->multiple > 0 ? CMD_WRITE_MULTIPLE
+                             : CMD_WRITE_SECTOR_RETRY));
+      for (i = 0; i < n; i++)
+        {
+          /* The disk asks for the first group of sectors at once,
+             then interrupts after each group it has received. */
+          if (i % block == 0)
+            {
+              if (i > 0)
+                sema_down (&c->completion_wait);
+              if (!wait_while_busy (d))
+                PANIC ("%s: disk write failed, sector=%"PRDSNu,
+                       d->name, sec_no + i);
+            }
+          output_sector (c, buffers[i]);
+        }
+      sema_down (&c->completion_wait);
+
+      sec_no += n;
+      buffers += n;
+      cnt -= n;
+    }
   lock_release (&c->lock);
 }
 
+/* Reads sector SEC_NO from disk D into BUFFER, which must have
+   room for BLOCK_SECTOR_SIZE bytes.
+   Internally synchronizes accesses to disks, so external
+   per-disk locking is unneeded. */
+static void
+ide_read (void *d, block_sector_t sec_no, void *buffer)
+{
+  ide_read_multiple (d, sec_no, 1, &buffer);
+}
+
+/* Write sector SEC_NO to disk D from BUFFER, which must contain
+   BLOCK_SECTOR_SIZE bytes.  Returns after the disk has
+   acknowledged receiving the data.
+   Internally synchronizes accesses to disks, so external
+   per-disk locking is unneeded. */
+static void
+ide_write (void *d, block_sector_t sec_no, const void *buffer)
+{
+  ide_write_multiple (d, sec_no, 1, &buffer);
+}
+
 static struct block_operations ide_operations =
   {
     ide_read,
-    ide_write
+    ide_write,
+    ide_read_multiple,
+    ide_write_multiple
   };
-
+
 /* Selects device D, waiting for it to become ready, and then
-   writes SEC_NO to the disk's sector selection registers.  (We
-   use LBA mode.) */
+   writes SEC_NO and CNT, the number of sectors to transfer, to
+   the disk's sector selection registers.  (We use LBA mode.) */
 static void
-select_sector (struct ata_disk *d, block_sector_t sec_no)
+select_sector (struct ata_disk *d, block_sector_t sec_no, size_t cnt)
 {
   struct channel *c = d->channel;
 
-  ASSERT (sec_no < (1UL << 28));
+  ASSERT (cnt > 0 && cnt <= MAX_TRANSFER_SECTORS);
+  ASSERT (sec_no + cnt <= (1UL << 28));
   
   select_device_wait (d);
-  outb (reg_nsect (c), 1);
+  outb (reg_nsect (c), cnt % MAX_TRANSFER_SECTORS);
   outb (reg_lbal (c), sec_no);
   outb (reg_lbam (c), sec_no >> 8);
   outb (reg_lbah (c), (sec_no >> 16));
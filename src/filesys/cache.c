@@ -0,0 +1,513 @@
+#include "filesys/cache.h"
+#include <debug.h>
+#include <stdlib.h>
+#include <string.h>
+#include "devices/timer.h"
+#include "filesys/filesys.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+
+/* Number of sectors held in the cache. */
+#define CACHE_SIZE 64
+
+/* Marks a cache entry that holds no sector. */
+#define NO_SECTOR ((block_sector_t) -1)
+
+/* Most sectors read from disk with one request by
+   cache_read_direct(). */
+#define DIRECT_RUN_MAX 64
+
+/* Most sectors waiting to be read ahead. */
+#define READ_AHEAD_MAX 32
+
+/* Timer ticks between runs of the flusher thread, and how long a
+   sector may stay dirty before the flusher writes it back.  Their
+   sum bounds how much is lost on a crash. */
+#define FLUSH_INTERVAL (TIMER_FREQ / 2)
+#define DIRTY_AGE TIMER_FREQ
+
+/* A cached sector of the file system device.
+   An entry's SECTOR only changes while both cache_lock and the
+   entry's lock are held, so either one is enough to read it. */
+struct cache_entry
+  {
+    struct lock lock;                   /* Held while DATA is in use. */
+    block_sector_t sector;              /* Sector held, or NO_SECTOR. */
+    bool dirty;                         /* Changed since written? */
+    int64_t dirty_since;                /* Tick DIRTY was set. */
+    bool accessed;                      /* Used since the clock passed? */
+    bool pinned;                        /* Kept off the disk? */
+    uint8_t data[BLOCK_SECTOR_SIZE];    /* Sector contents. */
+  };
+
+static struct cache_entry cache[CACHE_SIZE];
+
+/* Protects the sectors of the entries and the clock hand. */
+static struct lock cache_lock;
+static size_t hand;
+
+/* Sectors queued for the read-ahead thread, oldest first. */
+static block_sector_t read_ahead_queue[READ_AHEAD_MAX];
+static size_t read_ahead_cnt;
+static struct lock read_ahead_lock;
+static struct condition read_ahead_cond;  /* Signaled when queued. */
+
+static thread_func read_ahead_thread NO_RETURN;
+static thread_func flusher_thread NO_RETURN;
+static void write_back (int64_t dirty_before);
+static void write_entries (struct cache_entry **, size_t cnt,
+                           int64_t dirty_before);
+static int compare_sectors (const void *, const void *);
+static int compare_block_sectors (const void *, const void *);
+static struct cache_entry *lock_sector (block_sector_t, bool load);
+static struct cache_entry *lookup (block_sector_t);
+static bool copy_cached (block_sector_t, void *);
+static struct cache_entry *pick_victim (void);
+static struct cache_entry *store (block_sector_t, const void *, int ofs,
+                                  int size);
+
+/* Initializes the buffer cache. */
+void
+cache_init (void) 
+{
+  size_t i;
+
+  lock_init (&cache_lock);
+  for (i = 0; i < CACHE_SIZE; i++)
+    {
+      lock_init (&cache[i].lock);
+      cache[i].sector = NO_SECTOR;
+      cache[i].dirty = false;
+      cache[i].accessed = false;
+      cache[i].pinned = false;
+    }
+
+  lock_init (&read_ahead_lock);
+  cond_init (&read_ahead_cond);
+  thread_create ("read-ahead", PRI_DEFAULT, read_ahead_thread, NULL);
+  thread_create ("flusher", PRI_DEFAULT, flusher_thread, NULL);
+}
+
+/* Reads SIZE bytes starting at byte OFS of SECTOR into BUFFER,
+   through the cache. */
+void
+cache_read (block_sector_t sector, void *buffer, int ofs, int size) 
+{
+  struct cache_entry *e;
+
+  ASSERT (ofs >= 0 && size >= 0 && ofs + size <= BLOCK_SECTOR_SIZE);
+
+  e = lock_sector (sector, true);
+  memcpy (buffer, e->data + ofs, size);
+  lock_release (&e->lock);
+}
+
+/* Reads the CNT whole sectors starting at SECTOR into BUFFER.
+   Sectors in the cache are copied from it; each run of the
+   others is read from disk straight into BUFFER, with one
+   request, and is not cached, so that a large read costs one
+   copy and does not push other sectors out of the cache.  The
+   caller must keep the sectors from being written meanwhile, or
+   some of BUFFER may be stale. */
+void
+cache_read_direct (block_sector_t sector, size_t cnt, void *buffer_) 
+{
+  uint8_t *buffer = buffer_;
+  size_t i, run;
+
+  for (i = 0; i < cnt; i += run + 1)
+    {
+      void *buffers[DIRECT_RUN_MAX];
+
+      for (run = 0; i + run < cnt && run < DIRECT_RUN_MAX; run++)
+        {
+          void *dst = buffer + (i + run) * BLOCK_SECTOR_SIZE;
+          if (copy_cached (sector + i + run, dst))
+            break;
+          buffers[run] = dst;
+        }
+      block_read_multiple (fs_device, sector + i, run, buffers);
+
+      /* A run cut short by DIRECT_RUN_MAX did not look at the
+         sector after it. */
+      if (run == DIRECT_RUN_MAX)
+        run--;
+    }
+}
+
+/* Copies SECTOR into BUFFER and returns true if it is cached.
+   Returns false if it is not cached, in which case the disk
+   holds its latest contents: an entry being loaded or written
+   back keeps its sector until it is done. */
+static bool
+copy_cached (block_sector_t sector, void *buffer) 
+{
+  struct cache_entry *e;
+
+  lock_acquire (&cache_lock);
+  e = lookup (sector);
+  lock_release (&cache_lock);
+  if (e == NULL)
+    return false;
+
+  lock_acquire (&e->lock);
+  if (e->sector != sector)
+    {
+      /* Given to another sector, so written back already. */
+      lock_release (&e->lock);
+      return false;
+    }
+  e->accessed = true;
+  memcpy (buffer, e->data, BLOCK_SECTOR_SIZE);
+  lock_release (&e->lock);
+  return true;
+}
+
+/* Writes SIZE bytes from BUFFER starting at byte OFS of SECTOR.
+   The data reaches the disk when the sector is evicted, when the
+   flusher thread finds it old enough, or when the cache is
+   flushed.  Writing a whole sector does not read it. */
+void
+cache_write (block_sector_t sector, const void *buffer, int ofs, int size) 
+{
+  lock_release (&store (sector, buffer, ofs, size)->lock);
+}
+
+/* Like cache_write(), but also pins SECTOR: it stays in the
+   cache and is not written to disk until cache_unpin() is
+   called.  Used by the journal, which must log a sector before
+   it reaches its home location. */
+void
+cache_write_pinned (block_sector_t sector, const void *buffer, int ofs,
+                    int size) 
+{
+  struct cache_entry *e = store (sector, buffer, ofs, size);
+  e->pinned = true;
+  lock_release (&e->lock);
+}
+
+/* Unpins SECTOR, which must be in the cache, and writes it to
+   disk at once if WRITE is true.  Otherwise it is written back
+   like any other sector. */
+void
+cache_unpin (block_sector_t sector, bool write) 
+{
+  struct cache_entry *e = lock_sector (sector, true);
+
+  ASSERT (e->pinned);
+  e->pinned = false;
+  if (write && e->dirty)
+    {
+      block_write (fs_device, e->sector, e->data);
+      e->dirty = false;
+    }
+  lock_release (&e->lock);
+}
+
+/* Writes SIZE bytes from BUFFER starting at byte OFS of SECTOR
+   into the cache and returns SECTOR's entry, still locked. */
+static struct cache_entry *
+store (block_sector_t sector, const void *buffer, int ofs, int size) 
+{
+  struct cache_entry *e;
+
+  ASSERT (ofs >= 0 && size >= 0 && ofs + size <= BLOCK_SECTOR_SIZE);
+
+  e = lock_sector (sector, ofs > 0 || size < BLOCK_SECTOR_SIZE);
+  memcpy (e->data + ofs, buffer, size);
+  if (!e->dirty)
+    {
+      e->dirty = true;
+      e->dirty_since = timer_ticks ();
+    }
+  return e;
+}
+
+/* Writes every modified sector in the cache to disk, except
+   pinned sectors. */
+void
+cache_flush (void) 
+{
+  write_back (INT64_MAX);
+}
+
+/* Writes back the sectors that have been dirty for DIRTY_AGE
+   ticks, every FLUSH_INTERVAL ticks. */
+static void
+flusher_thread (void *aux UNUSED) 
+{
+  for (;;)
+    {
+      timer_sleep (FLUSH_INTERVAL);
+      write_back (timer_ticks () - DIRTY_AGE + 1);
+    }
+}
+
+/* Writes to disk the unpinned cached sectors that became dirty
+   before tick DIRTY_BEFORE, in ascending sector order so that the
+   disk head sweeps across them once.  Each run of consecutive
+   sectors is written with one request. */
+static void
+write_back (int64_t dirty_before) 
+{
+  struct cache_entry *victims[CACHE_SIZE];
+  size_t cnt = 0;
+  size_t i;
+
+  /* Entries only change sector under cache_lock, but may become
+     dirty or clean at any time, so write_entries() checks each
+     one again under its own lock. */
+  lock_acquire (&cache_lock);
+  for (i = 0; i < CACHE_SIZE; i++)
+    if (cache[i].sector != NO_SECTOR && cache[i].dirty && !cache[i].pinned)
+      victims[cnt++] = &cache[i];
+  qsort (victims, cnt, sizeof *victims, compare_sectors);
+  lock_release (&cache_lock);
+
+  write_entries (victims, cnt, dirty_before);
+}
+
+/* Writes to disk those of the CNT SECTORS that are cached, dirty,
+   and not pinned, in ascending sector order.  SECTORS is sorted
+   in place.  Used by the journal to get file data to disk before
+   committing metadata that refers to it. */
+void
+cache_write_sectors (block_sector_t *sectors, size_t cnt) 
+{
+  struct cache_entry *victims[CACHE_SIZE];
+  size_t victim_cnt = 0;
+  size_t i;
+
+  qsort (sectors, cnt, sizeof *sectors, compare_block_sectors);
+  lock_acquire (&cache_lock);
+  for (i = 0; i < cnt && victim_cnt < CACHE_SIZE; i++)
+    {
+      struct cache_entry *e = lookup (sectors[i]);
+      if (e != NULL && e->dirty && !e->pinned
+          && (victim_cnt == 0 || victims[victim_cnt - 1] != e))
+        victims[victim_cnt++] = e;
+    }
+  lock_release (&cache_lock);
+
+  write_entries (victims, victim_cnt, INT64_MAX);
+}
+
+/* Writes to disk those of the CNT entries in VICTIMS, which are
+   sorted by sector, that are still dirty and unpinned and became
+   dirty before tick DIRTY_BEFORE.  Each run of consecutive
+   sectors is written with one request. */
+static void
+write_entries (struct cache_entry **victims, size_t cnt,
+               int64_t dirty_before) 
+{
+  size_t i, j;
+
+  /* Only the first entry of a run is waited for.  The others are
+     only taken if they are free, since their sectors may have
+     changed since they were sorted, so that two threads writing
+     back at once could otherwise wait for each other. */
+  i = 0;
+  while (i < cnt)
+    {
+      struct cache_entry *run[CACHE_SIZE];
+      const void *buffers[CACHE_SIZE];
+      size_t run_cnt = 0;
+
+      for (; i < cnt; i++)
+        {
+          struct cache_entry *e = victims[i];
+          if (run_cnt == 0)
+            lock_acquire (&e->lock);
+          else if (!lock_try_acquire (&e->lock))
+            break;
+          if (e->sector == NO_SECTOR || !e->dirty || e->pinned
+              || e->dirty_since >= dirty_before)
+            {
+              lock_release (&e->lock);
+              continue;
+            }
+          if (run_cnt > 0 && e->sector != run[run_cnt - 1]->sector + 1)
+            {
+              /* Starts the next run. */
+              lock_release (&e->lock);
+              break;
+            }
+          run[run_cnt] = e;
+          buffers[run_cnt++] = e->data;
+        }
+
+      if (run_cnt > 0)
+        block_write_multiple (fs_device, run[0]->sector, run_cnt, buffers);
+      for (j = 0; j < run_cnt; j++)
+        {
+          run[j]->dirty = false;
+          lock_release (&run[j]->lock);
+        }
+    }
+}
+
+/* Orders pointers to cache entries by sector, for qsort(). */
+static int
+compare_sectors (const void *a_, const void *b_) 
+{
+  const struct cache_entry *a = *(struct cache_entry *const *) a_;
+  const struct cache_entry *b = *(struct cache_entry *const *) b_;
+
+  return a->sector < b->sector ? -1 : a->sector > b->sector;
+}
+
+/* Orders sector numbers, for qsort(). */
+static int
+compare_block_sectors (const void *a_, const void *b_) 
+{
+  block_sector_t a = *(const block_sector_t *) a_;
+  block_sector_t b = *(const block_sector_t *) b_;
+
+  return a < b ? -1 : a > b;
+}
+
+/* Asks for SECTOR to be brought into the cache in the background,
+   because a reader is expected to need it soon.  Does nothing if
+   SECTOR is already queued or if the queue is full. */
+void
+cache_read_ahead (block_sector_t sector) 
+{
+  size_t i;
+
+  lock_acquire (&read_ahead_lock);
+  for (i = 0; i < read_ahead_cnt; i++)
+    if (read_ahead_queue[i] == sector)
+      break;
+  if (i == read_ahead_cnt && read_ahead_cnt < READ_AHEAD_MAX)
+    {
+      read_ahead_queue[read_ahead_cnt++] = sector;
+      cond_signal (&read_ahead_cond, &read_ahead_lock);
+    }
+  lock_release (&read_ahead_lock);
+}
+
+/* Reads the sectors queued by cache_read_ahead() into the cache,
+   in the order they were queued. */
+static void
+read_ahead_thread (void *aux UNUSED) 
+{
+  for (;;)
+    {
+      block_sector_t sector;
+
+      lock_acquire (&read_ahead_lock);
+      while (read_ahead_cnt == 0)
+        cond_wait (&read_ahead_cond, &read_ahead_lock);
+      sector = read_ahead_queue[0];
+      memmove (read_ahead_queue, read_ahead_queue + 1,
+               --read_ahead_cnt * sizeof *read_ahead_queue);
+      lock_release (&read_ahead_lock);
+
+      lock_release (&lock_sector (sector, true)->lock);
+    }
+}
+
+/* Returns the entry holding SECTOR, locked by the current thread,
+   putting SECTOR into the cache if it is not there yet.  A newly
+   cached sector is read from disk if LOAD is true; otherwise the
+   caller must overwrite all of it. */
+static struct cache_entry *
+lock_sector (block_sector_t sector, bool load) 
+{
+  for (;;)
+    {
+      struct cache_entry *e;
+
+      lock_acquire (&cache_lock);
+      e = lookup (sector);
+      if (e != NULL)
+        {
+          /* The entry may be given to another sector while we
+             wait for it. */
+          lock_release (&cache_lock);
+          lock_acquire (&e->lock);
+          if (e->sector == sector)
+            {
+              e->accessed = true;
+              return e;
+            }
+          lock_release (&e->lock);
+          continue;
+        }
+
+      e = pick_victim ();
+      if (e == NULL)
+        {
+          /* Every entry is in use.  Let their holders finish. */
+          lock_release (&cache_lock);
+          thread_yield ();
+          continue;
+        }
+
+      if (e->dirty)
+        {
+          /* Write the victim back without holding up the rest of
+             the cache.  It keeps its sector meanwhile, so readers
+             of that sector wait for the write instead of reading
+             stale data from disk.  Then start over, since another
+             thread may have cached SECTOR in the meantime. */
+          lock_release (&cache_lock);
+          block_write (fs_device, e->sector, e->data);
+          e->dirty = false;
+          lock_release (&e->lock);
+          continue;
+        }
+
+      e->sector = sector;
+      e->accessed = true;
+      lock_release (&cache_lock);
+
+      if (load)
+        block_read (fs_device, sector, e->data);
+      return e;
+    }
+}
+
+/* Returns the entry holding SECTOR, or a null pointer if SECTOR
+   is not cached.  Must be called with cache_lock held. */
+static struct cache_entry *
+lookup (block_sector_t sector) 
+{
+  size_t i;
+
+  for (i = 0; i < CACHE_SIZE; i++)
+    if (cache[i].sector == sector)
+      return &cache[i];
+  return NULL;
+}
+
+/* Chooses an entry to hold a new sector with the clock algorithm,
+   giving recently accessed entries a second chance, and returns
+   it locked.  Pinned entries are never chosen.  Returns a null
+   pointer if every entry is pinned or locked by another thread.
+   Must be called with cache_lock held. */
+static struct cache_entry *
+pick_victim (void) 
+{
+  size_t i;
+
+  for (i = 0; i < CACHE_SIZE * 2; i++)
+    {
+      struct cache_entry *e = &cache[hand];
+      hand = (hand + 1) % CACHE_SIZE;
+
+      if (lock_held_by_current_thread (&e->lock)
+          || !lock_try_acquire (&e->lock))
+        continue;
+      if (e->pinned)
+        {
+          lock_release (&e->lock);
+          continue;
+        }
+      if (e->sector == NO_SECTOR || !e->accessed)
+        return e;
+      e->accessed = false;
+      lock_release (&e->lock);
+    }
+  return NULL;
+}
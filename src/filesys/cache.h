@@ -0,0 +1,17 @@
+#ifndef FILESYS_CACHE_H
+#define FILESYS_CACHE_H
+
+#include <stdbool.h>
+#include "devices/block.h"
+
+void cache_init (void);
+void cache_read (block_sector_t, void *, int ofs, int size);
+void cache_read_direct (block_sector_t, size_t cnt, void *);
+void cache_write (block_sector_t, const void *, int ofs, int size);
+void cache_write_pinned (block_sector_t, const void *, int ofs, int size);
+void cache_unpin (block_sector_t, bool write);
+void cache_flush (void);
+void cache_write_sectors (block_sector_t *, size_t cnt);
+void cache_read_ahead (block_sector_t);
+
+#endif /* filesys/cache.h */
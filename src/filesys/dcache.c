@@ -0,0 +1,175 @@
+#include "filesys/dcache.h"
+#include <debug.h>
+#include <hash.h>
+#include <list.h>
+#include <string.h>
+#include "filesys/directory.h"
+#include "threads/synch.h"
+
+/* Number of names held in the cache. */
+#define DCACHE_SIZE 64
+
+/* A cached directory entry: the inode sector of the file called
+   NAME in the directory whose inode is in sector DIR. */
+struct dentry
+  {
+    block_sector_t dir;                 /* Directory's inode sector. */
+    char name[NAME_MAX + 1];            /* Null terminated file name. */
+    block_sector_t sector;              /* File's inode sector. */
+    bool in_use;                        /* In use or free? */
+    struct hash_elem hash_elem;         /* Element in `dentries'. */
+    struct list_elem lru_elem;          /* Element in `lru'. */
+  };
+
+static struct dentry dentries[DCACHE_SIZE];
+
+/* Entries in use by directory and name, and all entries with the
+   least recently used first, so that free entries are reused
+   before any in use.  Protected by dcache_lock. */
+static struct hash names;
+static struct list lru;
+static struct lock dcache_lock;
+
+static struct dentry *find (block_sector_t dir, const char *name);
+static void discard (struct dentry *);
+static hash_hash_func dentry_hash;
+static hash_less_func dentry_less;
+
+/* Initializes the directory entry cache. */
+void
+dcache_init (void) 
+{
+  size_t i;
+
+  lock_init (&dcache_lock);
+  list_init (&lru);
+  if (!hash_init (&names, dentry_hash, dentry_less, NULL))
+    PANIC ("out of memory allocating directory entry cache");
+  for (i = 0; i < DCACHE_SIZE; i++)
+    {
+      dentries[i].in_use = false;
+      list_push_back (&lru, &dentries[i].lru_elem);
+    }
+}
+
+/* Looks up NAME in the directory whose inode is in sector DIR.
+   If the cache knows it, stores the sector of its inode in
+   *SECTORP and returns true.  Otherwise returns false. */
+bool
+dcache_lookup (block_sector_t dir, const char *name, block_sector_t *sectorp) 
+{
+  struct dentry *d;
+
+  lock_acquire (&dcache_lock);
+  d = find (dir, name);
+  if (d != NULL)
+    {
+      *sectorp = d->sector;
+      list_remove (&d->lru_elem);
+      list_push_back (&lru, &d->lru_elem);
+    }
+  lock_release (&dcache_lock);
+  return d != NULL;
+}
+
+/* Records that NAME in the directory whose inode is in sector DIR
+   has its inode in SECTOR, replacing the least recently used
+   entry. */
+void
+dcache_insert (block_sector_t dir, const char *name, block_sector_t sector) 
+{
+  struct dentry *d;
+
+  ASSERT (strlen (name) <= NAME_MAX);
+
+  lock_acquire (&dcache_lock);
+  d = find (dir, name);
+  if (d == NULL)
+    {
+      d = list_entry (list_front (&lru), struct dentry, lru_elem);
+      if (d->in_use)
+        hash_delete (&names, &d->hash_elem);
+      d->dir = dir;
+      strlcpy (d->name, name, sizeof d->name);
+      d->in_use = true;
+      hash_insert (&names, &d->hash_elem);
+    }
+  d->sector = sector;
+  list_remove (&d->lru_elem);
+  list_push_back (&lru, &d->lru_elem);
+  lock_release (&dcache_lock);
+}
+
+/* Forgets NAME in the directory whose inode is in sector DIR. */
+void
+dcache_remove (block_sector_t dir, const char *name) 
+{
+  struct dentry *d;
+
+  lock_acquire (&dcache_lock);
+  d = find (dir, name);
+  if (d != NULL)
+    discard (d);
+  lock_release (&dcache_lock);
+}
+
+/* Forgets every name in the directory whose inode is in sector
+   DIR, which is being removed, so that they do not show up in
+   a directory that later reuses the sector. */
+void
+dcache_remove_dir (block_sector_t dir) 
+{
+  size_t i;
+
+  lock_acquire (&dcache_lock);
+  for (i = 0; i < DCACHE_SIZE; i++)
+    if (dentries[i].in_use && dentries[i].dir == dir)
+      discard (&dentries[i]);
+  lock_release (&dcache_lock);
+}
+
+/* Returns the entry for NAME in directory DIR, or a null pointer
+   if there is none.  Must be called with dcache_lock held. */
+static struct dentry *
+find (block_sector_t dir, const char *name) 
+{
+  struct dentry key;
+  struct hash_elem *e;
+
+  if (strlen (name) > NAME_MAX)
+    return NULL;
+  key.dir = dir;
+  strlcpy (key.name, name, sizeof key.name);
+  e = hash_find (&names, &key.hash_elem);
+  return e != NULL ? hash_entry (e, struct dentry, hash_elem) : NULL;
+}
+
+/* Frees D, making it the first entry to be reused.
+   Must be called with dcache_lock held. */
+static void
+discard (struct dentry *d) 
+{
+  hash_delete (&names, &d->hash_elem);
+  d->in_use = false;
+  list_remove (&d->lru_elem);
+  list_push_front (&lru, &d->lru_elem);
+}
+
+static unsigned
+dentry_hash (const struct hash_elem *e, void *aux UNUSED) 
+{
+  const struct dentry *d = hash_entry (e, struct dentry, hash_elem);
+  return hash_string (d->name) ^ hash_int (d->dir);
+}
+
+static bool
+dentry_less (const struct hash_elem *a_, const struct hash_elem *b_,
+             void *aux UNUSED) 
+{
+  const struct dentry *a = hash_entry (a_, struct dentry, hash_elem);
+  const struct dentry *b = hash_entry (b_, struct dentry, hash_elem);
+
+  if (a->dir != b->dir)
+    return a->dir < b->dir;
+  return strcmp (a->name, b->name) < 0;
+}
@@ -1,7 +1,10 @@
 #include "filesys/directory.h"
 #include <stdio.h>
 #include <string.h>
+#include <hash.h>
 #include <list.h>
+#include <round.h>
+#include "filesys/dcache.h"
 #include "filesys/filesys.h"
 #include "filesys/inode.h"
 #include "threads/malloc.h"
@@ -11,6 +14,7 @@ struct dir
   {
     struct inode *inode;                /* Backing store. */
     off_t pos;                          /* Current position. */
+    bool walking;                       /* Partway through entries? */
   };
 
 /* A single directory entry. */
@@ -21,12 +25,111 @@ struct dir_entry
     bool in_use;                        /* In use or free? */
   };
 
-/* Creates a directory with space for ENTRY_CNT entries in the
-   given SECTOR.  Returns true if successful, false on failure. */
+/* Identifies a hashed directory. */
+#define DIR_MAGIC 0x48534944
+
+/* A table of buckets in a hashed directory: CNT buckets, one per
+   sector of the directory starting at sector FIRST. */
+struct bucket_table
+  {
+    uint32_t first;                     /* Sector of bucket 0. */
+    uint32_t cnt;                       /* Number of buckets. */
+  };
+
+/* Header in the first sector of a hashed directory.
+
+   A hashed directory's entries are kept in the buckets of TABLE.
+   A name goes in the first bucket with a free entry, starting
+   from the bucket its hash picks, so finding it takes a bounded
+   number of sector reads as long as the buckets are not too
+   full.  A bucket that was full when an entry was added is
+   marked as overflowed, telling lookups to go on to the next
+   bucket.
+
+   Once TABLE is three quarters full, the directory grows into
+   NEXT, a table twice as large placed after the end of the
+   directory.  Each entry added from then on goes into NEXT and
+   moves MOVE_CNT more of TABLE's entries there, in slot order,
+   so that every addition stays a small journal operation;
+   lookups search both tables meanwhile.  Once all of TABLE has
+   moved, NEXT takes its place, and TABLE becomes OLD, whose
+   sectors are freed by that and later additions as far as their
+   journal operations have room; the next replacement waits until
+   they all are.  No entries move while a dir_readdir() walk of
+   the directory is partway through, since an entry moved from
+   behind the walk into NEXT would be returned again.
+
+   A directory without the header is linear: an array of
+   entries that is searched in full. */
+struct dir_header
+  {
+    unsigned magic;                     /* DIR_MAGIC. */
+    uint32_t entry_cnt;                 /* Number of entries in use. */
+    struct bucket_table table;          /* Buckets. */
+    struct bucket_table next;           /* Buckets being filled, if
+                                           NEXT.CNT is nonzero. */
+    uint32_t moved;                     /* Slots of TABLE moved. */
+    struct bucket_table old;            /* Replaced buckets still to
+                                           be freed, if OLD.CNT is
+                                           nonzero. */
+  };
+
+/* Entries moved to the new table per entry added while a hashed
+   directory grows.  Each may go to a different bucket. */
+#define MOVE_CNT 2
+
+/* Entries in a bucket, followed by the bucket's overflow flag. */
+#define BUCKET_ENTRIES (BLOCK_SECTOR_SIZE / sizeof (struct dir_entry))
+
+static bool read_header (const struct dir *, struct dir_header *);
+static bool write_header (struct dir *, const struct dir_header *);
+static off_t slot_ofs (const struct bucket_table *, size_t bucket,
+                       size_t idx);
+static off_t next_slot (off_t ofs);
+static off_t walk_slot (const struct dir_header *, off_t ofs);
+static size_t home_bucket (const char *name, const struct bucket_table *);
+static bool is_overflowed (const struct dir *, const struct bucket_table *,
+                           size_t bucket);
+static bool table_lookup (const struct dir *, const struct bucket_table *,
+                          const char *name, struct dir_entry *, off_t *);
+static bool table_add (struct dir *, const struct bucket_table *,
+                       const struct dir_entry *, off_t *);
+static bool hashed_add (struct dir *, struct dir_header *,
+                        const struct dir_entry *);
+static bool start_growing (struct dir *, struct dir_header *);
+static bool move_entries (struct dir *, struct dir_header *);
+static void free_old_table (struct dir *, struct dir_header *);
+static void set_walking (struct dir *, bool walking);
+static bool is_dot (const char *name);
+static bool is_empty (const struct dir *);
+
+/* Creates a hashed directory with space for ENTRY_CNT entries in
+   the given SECTOR, inside the directory whose inode is in sector
+   PARENT.  The new directory holds entries "." and "..", for
+   itself and PARENT.  It grows as entries are added.
+   Returns true if successful, false on failure. */
 bool
-dir_create (block_sector_t sector, size_t entry_cnt)
+dir_create (block_sector_t sector, size_t entry_cnt, block_sector_t parent)
 {
-  return inode_create (sector, entry_cnt * sizeof (struct dir_entry));
+  struct dir_header h;
+  struct dir *dir;
+  bool success;
+
+  memset (&h, 0, sizeof h);
+  h.magic = DIR_MAGIC;
+  h.table.first = 1;
+  h.table.cnt = entry_cnt > BUCKET_ENTRIES
+                ? DIV_ROUND_UP (entry_cnt, BUCKET_ENTRIES) : 1;
+  if (!inode_create (sector, slot_ofs (&h.table, h.table.cnt, 0), true))
+    return false;
+
+  dir = dir_open (inode_open (sector));
+  success = (dir != NULL
+             && write_header (dir, &h)
+             && dir_add (dir, ".", sector)
+             && dir_add (dir, "..", parent));
+  dir_close (dir);
+  return success;
 }
 
 /* Opens and returns the directory for the given INODE, of which
@@ -39,6 +142,7 @@ dir_open (struct inode *inode)
     {
       dir->inode = inode;
       dir->pos = 0;
+      dir->walking = false;
       return dir;
     }
   else
@@ -71,6 +175,12 @@ dir_close (struct dir *dir)
 {
   if (dir != NULL)
     {
+      if (dir->walking)
+        {
+          inode_lock (dir->inode);
+          set_walking (dir, false);
+          inode_unlock (dir->inode);
+        }
       inode_close (dir->inode);
       free (dir);
     }
@@ -92,55 +202,108 @@ static bool
 lookup (const struct dir *dir, const char *name,
         struct dir_entry *ep, off_t *ofsp) 
 {
+  struct dir_header h;
   struct dir_entry e;
   size_t ofs;
   
   ASSERT (dir != NULL);
   ASSERT (name != NULL);
 
+  if (read_header (dir, &h))
+    return (table_lookup (dir, &h.table, name, ep, ofsp)
+            || (h.next.cnt > 0
+                && table_lookup (dir, &h.next, name, ep, ofsp)));
+
   for (ofs = 0; inode_read_at (dir->inode, &e, sizeof e, ofs) == sizeof e;
        ofs += sizeof e) 
     if (e.in_use && !strcmp (name, e.name)) 
-      {
-        if (ep != NULL)
-          *ep = e;
-        if (ofsp != NULL)
-          *ofsp = ofs;
-        return true;
-      }
+      goto found;
   return false;
+
+ found:
+  if (ep != NULL)
+    *ep = e;
+  if (ofsp != NULL)
+    *ofsp = ofs;
+  return true;
 }
 
 /* Searches DIR for a file with the given NAME
    and returns true if one exists, false otherwise.
    On success, sets *INODE to an inode for the file, otherwise to
-   a null pointer.  The caller must close *INODE. */
+   a null pointer.  The caller must close *INODE.
+   A removed directory has no entries, not even "." and "..". */
 bool
 dir_lookup (const struct dir *dir, const char *name,
             struct inode **inode) 
 {
+  block_sector_t dir_sector, sector;
   struct dir_entry e;
 
   ASSERT (dir != NULL);
   ASSERT (name != NULL);
 
-  if (lookup (dir, name, &e, NULL))
-    *inode = inode_open (e.inode_sector);
-  else
-    *inode = NULL;
+  dir_sector = inode_get_inumber (dir->inode);
+  *inode = NULL;
+
+  /* The entry cannot be removed before its inode is open. */
+  inode_lock (dir->inode);
+  if (!inode_is_removed (dir->inode))
+    {
+      if (dcache_lookup (dir_sector, name, &sector))
+        *inode = inode_open (sector);
+      else if (lookup (dir, name, &e, NULL))
+        {
+          dcache_insert (dir_sector, name, e.inode_sector);
+          *inode = inode_open (e.inode_sector);
+        }
+    }
+  inode_unlock (dir->inode);
 
   return *inode != NULL;
 }
 
+/* Returns true if DIR contains no entries but "." and "..". */
+bool
+dir_is_empty (const struct dir *dir) 
+{
+  bool empty;
+
+  inode_lock (dir->inode);
+  empty = is_empty (dir);
+  inode_unlock (dir->inode);
+  return empty;
+}
+
+/* Returns true if DIR contains no entries but "." and "..".
+   DIR's inode must be locked. */
+static bool
+is_empty (const struct dir *dir) 
+{
+  struct dir_header h;
+  struct dir_entry e;
+  off_t ofs;
+
+  if (read_header (dir, &h))
+    return h.entry_cnt <= 2;
+
+  for (ofs = 0; inode_read_at (dir->inode, &e, sizeof e, ofs) == sizeof e;
+       ofs += sizeof e) 
+    if (e.in_use && !is_dot (e.name))
+      return false;
+  return true;
+}
+
 /* Adds a file named NAME to DIR, which must not already contain a
    file by that name.  The file's inode is in sector
    INODE_SECTOR.
    Returns true if successful, false on failure.
-   Fails if NAME is invalid (i.e. too long) or a disk or memory
-   error occurs. */
+   Fails if NAME is invalid (i.e. too long), if DIR has been
+   removed, or if a disk or memory error occurs. */
 bool
 dir_add (struct dir *dir, const char *name, block_sector_t inode_sector)
 {
+  struct dir_header h;
   struct dir_entry e;
   off_t ofs;
   bool success = false;
@@ -152,10 +315,25 @@ dir_add (struct dir *dir, const char *name, block_sector_t inode_sector)
   if (*name == '\0' || strlen (name) > NAME_MAX)
     return false;
 
+  /* A removed directory may still be open, but must stay empty. */
+  inode_lock (dir->inode);
+  if (inode_is_removed (dir->inode))
+    goto done;
+
   /* Check that NAME is not in use. */
   if (lookup (dir, name, NULL, NULL))
     goto done;
 
+  if (read_header (dir, &h))
+    {
+      memset (&e, 0, sizeof e);
+      e.in_use = true;
+      strlcpy (e.name, name, sizeof e.name);
+      e.inode_sector = inode_sector;
+      success = hashed_add (dir, &h, &e);
+      goto done;
+    }
+
   /* Set OFS to offset of free slot.
      If there are no free slots, then it will be set to the
      current end-of-file.
@@ -175,17 +353,22 @@ dir_add (struct dir *dir, const char *name, block_sector_t inode_sector)
   success = inode_write_at (dir->inode, &e, sizeof e, ofs) == sizeof e;
 
  done:
+  inode_unlock (dir->inode);
   return success;
 }
 
 /* Removes any entry for NAME in DIR.
-   Returns true if successful, false on failure,
-   which occurs only if there is no file with the given NAME. */
+   Returns true if successful, false on failure, which occurs if
+   there is no file with the given NAME, if NAME is "." or "..",
+   or if NAME is a directory that is not empty. */
 bool
 dir_remove (struct dir *dir, const char *name) 
 {
+  struct dir_header h;
   struct dir_entry e;
   struct inode *inode = NULL;
+  bool victim_locked = false;
+  bool hashed;
   bool success = false;
   off_t ofs;
 
@@ -193,7 +376,8 @@ dir_remove (struct dir *dir, const char *name)
   ASSERT (name != NULL);
 
   /* Find directory entry. */
-  if (!lookup (dir, name, &e, &ofs))
+  inode_lock (dir->inode);
+  if (is_dot (name) || !lookup (dir, name, &e, &ofs))
     goto done;
 
   /* Open inode. */
@@ -201,36 +385,401 @@ dir_remove (struct dir *dir, const char *name)
   if (inode == NULL)
     goto done;
 
-  /* Erase directory entry. */
+  /* Only empty directories may be removed.  The victim stays
+     locked until it is marked removed, so that nothing is added
+     to it in between. */
+  if (inode_is_dir (inode))
+    {
+      struct dir *victim = dir_open (inode_reopen (inode));
+      bool empty;
+
+      inode_lock (inode);
+      victim_locked = true;
+      empty = victim != NULL && is_empty (victim);
+      dir_close (victim);
+      if (!empty)
+        goto done;
+      dcache_remove_dir (e.inode_sector);
+    }
+  dcache_remove (inode_get_inumber (dir->inode), name);
+
+  /* Erase directory entry.  A hashed directory's header is logged
+     first, so that the journal operation cannot run out of room
+     for the new count after the entry is gone. */
+  hashed = read_header (dir, &h);
+  if (hashed && !write_header (dir, &h))
+    goto done;
   e.in_use = false;
   if (inode_write_at (dir->inode, &e, sizeof e, ofs) != sizeof e) 
     goto done;
+  if (hashed)
+    {
+      h.entry_cnt--;
+      write_header (dir, &h);
+    }
 
   /* Remove inode. */
   inode_remove (inode);
   success = true;
 
  done:
+  if (victim_locked)
+    inode_unlock (inode);
+  inode_unlock (dir->inode);
   inode_close (inode);
   return success;
 }
 
 /* Reads the next directory entry in DIR and stores the name in
    NAME.  Returns true if successful, false if the directory
-   contains no more entries. */
+   contains no more entries.  "." and ".." are skipped.
+   From the first entry returned until the last, or until DIR is
+   closed or sought back to the start, DIR's entries are not moved
+   between tables, so no entry is returned twice. */
 bool
 dir_readdir (struct dir *dir, char name[NAME_MAX + 1])
 {
+  struct dir_header h;
   struct dir_entry e;
+  bool hashed;
+  bool found = false;
+  off_t ofs;
 
-  while (inode_read_at (dir->inode, &e, sizeof e, dir->pos) == sizeof e) 
+  inode_lock (dir->inode);
+  hashed = read_header (dir, &h);
+
+  while (!found
+         && (ofs = hashed ? walk_slot (&h, dir->pos) : dir->pos) >= 0
+         && inode_read_at (dir->inode, &e, sizeof e, ofs) == sizeof e) 
     {
-      dir->pos += sizeof e;
-      if (e.in_use)
+      if (hashed)
+        dir->pos = next_slot (ofs);
+      else
+        dir->pos = ofs + sizeof e;
+      if (e.in_use && !is_dot (e.name))
         {
           strlcpy (name, e.name, NAME_MAX + 1);
-          return true;
+          found = true;
         } 
     }
+  set_walking (dir, found);
+  inode_unlock (dir->inode);
+  return found;
+}
+
+/* Makes the next dir_readdir() on DIR start at byte POS of its
+   entries, as returned by dir_tell(). */
+void
+dir_seek (struct dir *dir, off_t pos) 
+{
+  inode_lock (dir->inode);
+  dir->pos = pos;
+  set_walking (dir, pos != 0);
+  inode_unlock (dir->inode);
+}
+
+/* Notes whether DIR is partway through its entries, so that they
+   are not moved meanwhile.  DIR's inode must be locked. */
+static void
+set_walking (struct dir *dir, bool walking) 
+{
+  if (walking != dir->walking)
+    {
+      if (walking)
+        inode_open_cursor (dir->inode);
+      else
+        inode_close_cursor (dir->inode);
+      dir->walking = walking;
+    }
+}
+
+/* Returns the position in DIR's entries of the next
+   dir_readdir(). */
+off_t
+dir_tell (const struct dir *dir) 
+{
+  return dir->pos;
+}
+
+/* Reads DIR's header into *H.  Returns true if DIR is hashed,
+   false if it is linear. */
+static bool
+read_header (const struct dir *dir, struct dir_header *h) 
+{
+  return (inode_read_at (dir->inode, h, sizeof *h, 0) == sizeof *h
+          && h->magic == DIR_MAGIC);
+}
+
+/* Writes H as DIR's header.  Returns true if successful. */
+static bool
+write_header (struct dir *dir, const struct dir_header *h) 
+{
+  return inode_write_at (dir->inode, h, sizeof *h, 0) == sizeof *h;
+}
+
+/* Returns the byte offset of entry IDX of BUCKET of bucket table
+   T.  Entry BUCKET_ENTRIES is the overflow flag. */
+static off_t
+slot_ofs (const struct bucket_table *t, size_t bucket, size_t idx) 
+{
+  return ((t->first + bucket) * BLOCK_SECTOR_SIZE
+          + idx * sizeof (struct dir_entry));
+}
+
+/* Returns the offset of the entry after the one at OFS in a
+   hashed directory, skipping overflow flags. */
+static off_t
+next_slot (off_t ofs) 
+{
+  ofs += sizeof (struct dir_entry);
+  if (ofs % BLOCK_SECTOR_SIZE
+      >= (off_t) (BUCKET_ENTRIES * sizeof (struct dir_entry)))
+    ofs = ROUND_UP (ofs, BLOCK_SECTOR_SIZE);
+  return ofs;
+}
+
+/* Returns the offset of the first entry at or after OFS of the
+   hashed directory whose header is H, walking the buckets of
+   H->table and then those of H->next and skipping everything
+   else, or -1 if there is none. */
+static off_t
+walk_slot (const struct dir_header *h, off_t ofs) 
+{
+  if (ofs < slot_ofs (&h->table, 0, 0))
+    return slot_ofs (&h->table, 0, 0);
+  if (ofs < slot_ofs (&h->table, h->table.cnt, 0))
+    return ofs;
+  if (h->next.cnt == 0)
+    return -1;
+  if (ofs < slot_ofs (&h->next, 0, 0))
+    return slot_ofs (&h->next, 0, 0);
+  if (ofs < slot_ofs (&h->next, h->next.cnt, 0))
+    return ofs;
+  return -1;
+}
+
+/* Returns the bucket of table T where the search for NAME
+   starts. */
+static size_t
+home_bucket (const char *name, const struct bucket_table *t) 
+{
+  return hash_string (name) % t->cnt;
+}
+
+/* Returns true if BUCKET of table T of hashed directory DIR was
+   full when an entry was added to it. */
+static bool
+is_overflowed (const struct dir *dir, const struct bucket_table *t,
+               size_t bucket) 
+{
+  bool overflowed;
+
+  return (inode_read_at (dir->inode, &overflowed, sizeof overflowed,
+                         slot_ofs (t, bucket, BUCKET_ENTRIES))
+          == sizeof overflowed
+          && overflowed);
+}
+
+/* Searches table T of hashed directory DIR for NAME, probing from
+   NAME's bucket until one that never overflowed.  On success,
+   acts like lookup(). */
+static bool
+table_lookup (const struct dir *dir, const struct bucket_table *t,
+              const char *name, struct dir_entry *ep, off_t *ofsp) 
+{
+  size_t home = home_bucket (name, t);
+  size_t i, j;
+
+  for (i = 0; i < t->cnt; i++) 
+    {
+      size_t bucket = (home + i) % t->cnt;
+      for (j = 0; j < BUCKET_ENTRIES; j++) 
+        {
+          struct dir_entry e;
+          off_t ofs = slot_ofs (t, bucket, j);
+
+          if (inode_read_at (dir->inode, &e, sizeof e, ofs) == sizeof e
+              && e.in_use && !strcmp (name, e.name))
+            {
+              if (ep != NULL)
+                *ep = e;
+              if (ofsp != NULL)
+                *ofsp = ofs;
+              return true;
+            }
+        }
+      if (!is_overflowed (dir, t, bucket))
+        break;
+    }
+  return false;
+}
+
+/* Adds entry E to table T of hashed directory DIR, in the first
+   free slot from E's bucket on, and stores the slot's offset into
+   *OFSP if OFSP is non-null.  Returns true if successful. */
+static bool
+table_add (struct dir *dir, const struct bucket_table *t,
+           const struct dir_entry *e, off_t *ofsp)
+{
+  size_t home = home_bucket (e->name, t);
+  size_t i, j;
+
+  for (i = 0; i < t->cnt; i++) 
+    {
+      size_t bucket = (home + i) % t->cnt;
+      bool overflowed = true;
+
+      for (j = 0; j < BUCKET_ENTRIES; j++) 
+        {
+          struct dir_entry slot;
+          off_t ofs = slot_ofs (t, bucket, j);
+
+          if (inode_read_at (dir->inode, &slot, sizeof slot, ofs)
+              != sizeof slot)
+            return false;
+          if (!slot.in_use)
+            {
+              if (ofsp != NULL)
+                *ofsp = ofs;
+              return (inode_write_at (dir->inode, e, sizeof *e, ofs)
+                      == sizeof *e);
+            }
+        }
+
+      /* Lookups for E must continue past this bucket. */
+      if (!is_overflowed (dir, t, bucket)
+          && (inode_write_at (dir->inode, &overflowed, sizeof overflowed,
+                              slot_ofs (t, bucket, BUCKET_ENTRIES))
+              != sizeof overflowed))
+        return false;
+    }
   return false;
 }
+
+/* Adds entry E to hashed directory DIR, whose header is *H, and
+   writes the header back.  Starts growing DIR if its table is
+   three quarters full; while it grows, E goes into the new table
+   and MOVE_CNT more entries move there.
+   Returns true if successful. */
+static bool
+hashed_add (struct dir *dir, struct dir_header *h, const struct dir_entry *e)
+{
+  bool success;
+
+  /* The header is logged first, so that the journal operation
+     cannot run out of room for it once E is in. */
+  if (!write_header (dir, h))
+    return false;
+
+  /* A failure to grow only makes probing slower, and one to move
+     entries, for example because the journal operation ran out of
+     room, is retried by the next addition. */
+  if (h->next.cnt == 0
+      && (h->entry_cnt + 1) * 4 > h->table.cnt * BUCKET_ENTRIES * 3)
+    start_growing (dir, h);
+
+  success = table_add (dir, h->next.cnt > 0 ? &h->next : &h->table, e,
+                       NULL);
+  if (success)
+    h->entry_cnt++;
+  if (h->next.cnt > 0)
+    move_entries (dir, h);
+  free_old_table (dir, h);
+  return write_header (dir, h) && success;
+}
+
+/* Starts growing hashed directory DIR, whose header is *H, into a
+   table of twice as many buckets after the end of DIR.  The new
+   buckets are a hole, which reads as empty buckets.
+   Returns true if successful, false if DIR cannot be extended. */
+static bool
+start_growing (struct dir *dir, struct dir_header *h) 
+{
+  struct bucket_table next;
+  bool zero = false;
+
+  next.first = DIV_ROUND_UP (inode_length (dir->inode), BLOCK_SECTOR_SIZE);
+  next.cnt = h->table.cnt * 2;
+  if (inode_write_at (dir->inode, &zero, sizeof zero,
+                      slot_ofs (&next, next.cnt, 0) - sizeof zero)
+      != sizeof zero)
+    return false;
+
+  h->next = next;
+  h->moved = 0;
+  return true;
+}
+
+/* Moves the next MOVE_CNT entries of hashed directory DIR's
+   table into the table it is growing into, where H is DIR's
+   header, and replaces the table by the new one once all of it
+   has moved and the table replaced before is freed.  Does
+   nothing while a dir_readdir() walk of DIR is partway through.
+   Returns true if successful. */
+static bool
+move_entries (struct dir *dir, struct dir_header *h) 
+{
+  size_t slot_cnt = h->table.cnt * BUCKET_ENTRIES;
+  size_t moved_cnt = 0;
+
+  if (inode_has_cursors (dir->inode))
+    return true;
+
+  while (moved_cnt < MOVE_CNT && h->moved < slot_cnt)
+    {
+      struct dir_entry e;
+      off_t ofs = slot_ofs (&h->table, h->moved / BUCKET_ENTRIES,
+                            h->moved % BUCKET_ENTRIES);
+
+      if (inode_read_at (dir->inode, &e, sizeof e, ofs) != sizeof e)
+        return false;
+      if (e.in_use)
+        {
+          /* The entry is in exactly one table at a time.  Its old
+             bucket keeps its overflow flag, so that lookups of the
+             entries still behind it go on past it.  If the old
+             slot cannot be cleared, the copy is, which cannot run
+             out of journal room since its sector is logged. */
+          off_t new_ofs;
+
+          if (!table_add (dir, &h->next, &e, &new_ofs))
+            return false;
+          e.in_use = false;
+          if (inode_write_at (dir->inode, &e, sizeof e, ofs) != sizeof e)
+            {
+              inode_write_at (dir->inode, &e, sizeof e, new_ofs);
+              return false;
+            }
+          moved_cnt++;
+        }
+      h->moved++;
+    }
+
+  if (h->moved == slot_cnt && h->old.cnt == 0)
+    {
+      h->old = h->table;
+      h->table = h->next;
+      h->next.first = h->next.cnt = 0;
+      h->moved = 0;
+    }
+  return true;
+}
+
+/* Frees the buckets of the table that hashed directory DIR, whose
+   header is *H, replaced, from the last one down, as far as the
+   journal operation has room. */
+static void
+free_old_table (struct dir *dir, struct dir_header *h) 
+{
+  while (h->old.cnt > 0
+         && inode_punch_hole (dir->inode, BLOCK_SECTOR_SIZE,
+                              slot_ofs (&h->old, h->old.cnt - 1, 0)))
+    h->old.cnt--;
+}
+
+/* Returns true if NAME is "." or "..". */
+static bool
+is_dot (const char *name) 
+{
+  return !strcmp (name, ".") || !strcmp (name, "..");
+}
@@ -3,14 +3,21 @@
 #include "filesys/inode.h"
 #include "threads/malloc.h"
 
+/* Bytes read ahead of a sequential reader. */
+#define READ_AHEAD_BYTES (8 * BLOCK_SECTOR_SIZE)
+
 /* An open file. */
 struct file 
   {
     struct inode *inode;        /* File's inode. */
     off_t pos;                  /* Current position. */
     bool deny_write;            /* Has file_deny_write() been called? */
+    off_t read_end;             /* Position after the last file_read(). */
+    off_t ahead_end;            /* End of the bytes read ahead. */
   };
 
+static void read_ahead (struct file *);
+
 /* Opens a file for the given INODE, of which it takes ownership,
    and returns the new file.  Returns a null pointer if an
    allocation fails or if INODE is null. */
@@ -23,6 +30,8 @@ file_open (struct inode *inode)
       file->inode = inode;
       file->pos = 0;
       file->deny_write = false;
+      file->read_end = 0;
+      file->ahead_end = 0;
       return file;
     }
   else
@@ -64,15 +73,36 @@ file_get_inode (struct file *file)
    starting at the file's current position.
    Returns the number of bytes actually read,
    which may be less than SIZE if end of file is reached.
-   Advances FILE's position by the number of bytes read. */
+   Advances FILE's position by the number of bytes read.
+   A read that continues where the previous one ended starts
+   reading the following bytes ahead, in the background. */
 off_t
 file_read (struct file *file, void *buffer, off_t size) 
 {
+  bool sequential = file->pos == file->read_end;
   off_t bytes_read = inode_read_at (file->inode, buffer, size, file->pos);
   file->pos += bytes_read;
+  file->read_end = file->pos;
+  if (sequential && bytes_read > 0)
+    read_ahead (file);
   return bytes_read;
 }
 
+/* Reads the READ_AHEAD_BYTES after FILE's position ahead, except
+   those already requested. */
+static void
+read_ahead (struct file *file) 
+{
+  off_t start = file->ahead_end > file->pos ? file->ahead_end : file->pos;
+  off_t end = file->pos + READ_AHEAD_BYTES;
+
+  if (start < end)
+    {
+      inode_read_ahead (file->inode, end - start, start);
+      file->ahead_end = end;
+    }
+}
+
 /* Reads SIZE bytes from FILE into BUFFER,
    starting at offset FILE_OFS in the file.
    Returns the number of bytes actually read,
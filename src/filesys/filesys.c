@@ -2,15 +2,43 @@
 #include <debug.h>
 #include <stdio.h>
 #include <string.h>
+#include "filesys/cache.h"
+#include "filesys/dcache.h"
 #include "filesys/file.h"
 #include "filesys/free-map.h"
 #include "filesys/inode.h"
 #include "filesys/directory.h"
+#include "filesys/journal.h"
+#include "threads/thread.h"
 
 /* Partition that contains the file system. */
 struct block *fs_device;
 
+/* Identifies the superblock. */
+#define SUPERBLOCK_MAGIC 0x53555042
+
+/* On-disk superblock, in sector SUPERBLOCK_SECTOR.
+   Must be exactly BLOCK_SECTOR_SIZE bytes long. */
+struct superblock
+  {
+    unsigned magic;                     /* Magic number. */
+    uint32_t clean;                     /* Unmounted cleanly? */
+    uint32_t free_cnt;                  /* Free sectors, if CLEAN. */
+    uint8_t unused[BLOCK_SECTOR_SIZE - 12]; /* Not used. */
+  };
+
+/* False if the disk has no superblock, in which case sector
+   SUPERBLOCK_SECTOR may belong to a file and must not be
+   written. */
+static bool has_superblock;
+
 static void do_format (void);
+static void mount (void);
+static void write_superblock (bool clean);
+static bool create (const char *name, off_t initial_size, bool is_dir);
+static int get_next_part (char part[NAME_MAX + 1], const char **srcp);
+static bool resolve_path (const char *path, struct dir **dirp,
+                          char part[NAME_MAX + 1]);
 
 /* Initializes the file system module.
    If FORMAT is true, reformats the file system. */
@@ -21,13 +49,16 @@ filesys_init (bool format)
   if (fs_device == NULL)
     PANIC ("No file system device found, can't initialize file system.");
 
+  cache_init ();
+  dcache_init ();
   inode_init ();
   free_map_init ();
+  journal_init (format);
 
   if (format) 
     do_format ();
 
-  free_map_open ();
+  mount ();
 }
 
 /* Shuts down the file system module, writing any unwritten data
@@ -35,7 +66,13 @@ filesys_init (bool format)
 void
 filesys_done (void) 
 {
+  journal_begin ();
   free_map_close ();
+  journal_end ();
+  journal_flush ();
+  cache_flush ();
+  if (has_superblock)
+    write_superblock (true);
 }
 
 /* Creates a file named NAME with the given INITIAL_SIZE.
@@ -45,20 +82,20 @@ filesys_done (void)
 bool
 filesys_create (const char *name, off_t initial_size) 
 {
-  block_sector_t inode_sector = 0;
-  struct dir *dir = dir_open_root ();
-  bool success = (dir != NULL
-                  && free_map_allocate (1, &inode_sector)
-                  && inode_create (inode_sector, initial_size)
-                  && dir_add (dir, name, inode_sector));
-  if (!success && inode_sector != 0) 
-    free_map_release (inode_sector, 1);
-  dir_close (dir);
+  return create (name, initial_size, false);
+}
 
-  return success;
+/* Creates an empty directory named NAME.
+   Returns true if successful, false otherwise.
+   Fails if a file named NAME already exists,
+   or if internal memory allocation fails. */
+bool
+filesys_mkdir (const char *name) 
+{
+  return create (name, 0, true);
 }
 
-/* Opens the file with the given NAME.
+/* Opens the file or directory with the given NAME.
    Returns the new file if successful or a null pointer
    otherwise.
    Fails if no file named NAME exists,
@@ -66,38 +103,261 @@ filesys_create (const char *name, off_t initial_size)
 struct file *
 filesys_open (const char *name)
 {
-  struct dir *dir = dir_open_root ();
+  char part[NAME_MAX + 1];
+  struct dir *dir;
   struct inode *inode = NULL;
 
-  if (dir != NULL)
-    dir_lookup (dir, name, &inode);
+  if (!resolve_path (name, &dir, part))
+    return NULL;
+  if (*part == '\0')
+    inode = inode_reopen (dir_get_inode (dir));
+  else
+    dir_lookup (dir, part, &inode);
   dir_close (dir);
 
   return file_open (inode);
 }
 
-/* Deletes the file named NAME.
+/* Deletes the file or empty directory named NAME.
    Returns true if successful, false on failure.
    Fails if no file named NAME exists,
    or if an internal memory allocation fails. */
 bool
 filesys_remove (const char *name) 
 {
-  struct dir *dir = dir_open_root ();
-  bool success = dir != NULL && dir_remove (dir, name);
-  dir_close (dir); 
+  char part[NAME_MAX + 1];
+  struct dir *dir;
+  bool success = false;
+
+  if (resolve_path (name, &dir, part))
+    {
+      /* Hold the file open until its removal is done, so that its
+         blocks are freed afterward, in journal operations of
+         their own. */
+      struct inode *inode;
+
+      dir_lookup (dir, part, &inode);
+      journal_begin ();
+      success = dir_remove (dir, part);
+      journal_end ();
+      inode_close (inode);
+      dir_close (dir); 
+    }
 
   return success;
 }
-
+
+/* Makes the directory named NAME the current thread's working
+   directory.  Returns true if successful, false on failure. */
+bool
+filesys_chdir (const char *name) 
+{
+  struct thread *cur = thread_current ();
+  struct file *file = filesys_open (name);
+  struct dir *dir = NULL;
+
+  if (file != NULL && inode_is_dir (file_get_inode (file)))
+    dir = dir_open (inode_reopen (file_get_inode (file)));
+  file_close (file);
+  if (dir == NULL)
+    return false;
+
+  dir_close (cur->cwd);
+  cur->cwd = dir;
+  return true;
+}
+
+/* Creates a file, or a directory if IS_DIR is true, named NAME
+   and INITIAL_SIZE bytes long.  Its inode is placed near the
+   inode of the directory containing it.  The whole creation is
+   one journal operation, so a crash cannot leave the inode
+   allocated but not in a directory. */
+static bool
+create (const char *name, off_t initial_size, bool is_dir) 
+{
+  char part[NAME_MAX + 1];
+  block_sector_t parent, inode_sector;
+  struct dir *dir;
+  bool success = false;
+
+  journal_begin ();
+  if (!resolve_path (name, &dir, part))
+    {
+      journal_end ();
+      return false;
+    }
+  parent = inode_get_inumber (dir_get_inode (dir));
+
+  if (*part != '\0' && free_map_allocate_near (parent, 1, &inode_sector))
+    {
+      if (!(is_dir
+            ? dir_create (inode_sector, 16, parent)
+            : inode_create (inode_sector, initial_size, false)))
+        free_map_release (inode_sector, 1);
+      else if (!dir_add (dir, part, inode_sector))
+        {
+          /* Release the new inode along with any data it has. */
+          struct inode *inode = inode_open (inode_sector);
+          if (inode != NULL)
+            {
+              inode_remove (inode);
+              inode_close (inode);
+            }
+        }
+      else
+        success = true;
+    }
+  free_map_flush ();
+  dir_close (dir);
+  journal_end ();
+
+  return success;
+}
+
+/* Extracts a file name part from *SRCP into PART, and updates
+   *SRCP so that the next call will return the next file name
+   part.  Returns 1 if successful, 0 at end of string, -1 for a
+   too-long file name part. */
+static int
+get_next_part (char part[NAME_MAX + 1], const char **srcp) 
+{
+  const char *src = *srcp;
+  char *dst = part;
+
+  /* Skip leading slashes.  If it's all slashes, we're done. */
+  while (*src == '/')
+    src++;
+  if (*src == '\0')
+    return 0;
+
+  /* Copy up to NAME_MAX character from SRC to DST.  Add null
+     terminator. */
+  while (*src != '/' && *src != '\0') 
+    {
+      if (dst < part + NAME_MAX)
+        *dst++ = *src;
+      else
+        return -1;
+      src++; 
+    }
+  *dst = '\0';
+
+  /* Advance source pointer. */
+  *srcp = src;
+  return 1;
+}
+
+/* Walks PATH, which is absolute if it starts with "/" and
+   relative to the current thread's working directory otherwise,
+   up to its last part.  Stores the directory that should contain
+   the last part into *DIRP, which the caller must close, and the
+   last part into PART.  PART is empty if PATH names the root
+   directory.
+   Returns true if successful, false if PATH is empty, if a
+   part is too long, or if a part before the last is not a
+   directory. */
+static bool
+resolve_path (const char *path, struct dir **dirp, char part[NAME_MAX + 1]) 
+{
+  struct dir *cwd = thread_current ()->cwd;
+  char next[NAME_MAX + 1];
+  struct dir *dir;
+  int result;
+
+  if (*path == '\0')
+    return false;
+  if (*path == '/' || cwd == NULL)
+    dir = dir_open_root ();
+  else
+    dir = dir_reopen (cwd);
+  if (dir == NULL)
+    return false;
+
+  result = get_next_part (part, &path);
+  if (result == 0)
+    *part = '\0';
+  while (result > 0 && (result = get_next_part (next, &path)) > 0)
+    {
+      struct inode *inode;
+
+      /* PART is not the last, so it must be a directory. */
+      dir_lookup (dir, part, &inode);
+      dir_close (dir);
+      if (inode == NULL || !inode_is_dir (inode))
+        {
+          inode_close (inode);
+          return false;
+        }
+      dir = dir_open (inode);
+      if (dir == NULL)
+        return false;
+      strlcpy (part, next, NAME_MAX + 1);
+    }
+
+  if (result < 0)
+    {
+      dir_close (dir);
+      return false;
+    }
+  *dirp = dir;
+  return true;
+}
+
 /* Formats the file system. */
 static void
 do_format (void)
 {
   printf ("Formatting file system...");
   free_map_create ();
-  if (!dir_create (ROOT_DIR_SECTOR, 16))
+  journal_begin ();
+  if (!dir_create (ROOT_DIR_SECTOR, 16, ROOT_DIR_SECTOR))
     PANIC ("root directory creation failed");
   free_map_close ();
+  journal_end ();
+  journal_flush ();
+  cache_flush ();
+  write_superblock (true);
   printf ("done.\n");
 }
+
+/* Opens the free map.  After a clean unmount, the superblock
+   holds the number of free sectors, so the free map is read
+   lazily; otherwise it is read whole, to count them.  Then marks
+   the file system as mounted, until filesys_done(). */
+static void
+mount (void) 
+{
+  struct superblock sb;
+
+  ASSERT (sizeof sb == BLOCK_SECTOR_SIZE);
+
+  block_read (fs_device, SUPERBLOCK_SECTOR, &sb);
+  has_superblock = sb.magic == SUPERBLOCK_MAGIC;
+  if (has_superblock && sb.clean)
+    free_map_open (true, sb.free_cnt);
+  else
+    {
+      if (has_superblock)
+        printf ("filesys: not cleanly unmounted, reading free map\n");
+      free_map_open (false, 0);
+    }
+
+  if (has_superblock)
+    write_superblock (false);
+}
+
+/* Writes the superblock, marking the file system as unmounted
+   cleanly if CLEAN is true or as mounted otherwise.  Everything
+   else must be on disk before it is marked clean. */
+static void
+write_superblock (bool clean) 
+{
+  struct superblock sb;
+
+  memset (&sb, 0, sizeof sb);
+  sb.magic = SUPERBLOCK_MAGIC;
+  sb.clean = clean;
+  sb.free_cnt = clean ? free_map_free_cnt () : 0;
+  block_write (fs_device, SUPERBLOCK_SECTOR, &sb);
+  has_superblock = true;
+}
@@ -7,6 +7,8 @@
 /* Sectors of system file inodes. */
 #define FREE_MAP_SECTOR 0       /* Free map file inode sector. */
 #define ROOT_DIR_SECTOR 1       /* Root directory file inode sector. */
+#define SUPERBLOCK_SECTOR 2     /* Superblock sector. */
+#define JOURNAL_SECTOR 3        /* Metadata journal header sector. */
 
 /* Block device that contains the file system. */
 extern struct block *fs_device;
@@ -16,5 +18,7 @@ void filesys_done (void);
 bool filesys_create (const char *name, off_t initial_size);
 struct file *filesys_open (const char *name);
 bool filesys_remove (const char *name);
+bool filesys_mkdir (const char *name);
+bool filesys_chdir (const char *name);
 
 #endif /* filesys/filesys.h */
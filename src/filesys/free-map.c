@@ -1,85 +1,647 @@
 #include "filesys/free-map.h"
 #include <bitmap.h>
 #include <debug.h>
+#include <list.h>
+#include <round.h>
 #include "filesys/file.h"
 #include "filesys/filesys.h"
 #include "filesys/inode.h"
+#include "filesys/journal.h"
+#include "threads/malloc.h"
+#include "threads/synch.h"
 
 static struct file *free_map_file;   /* Free map file. */
 static struct bitmap *free_map;      /* Free map, one bit per sector. */
 
+/* Sectors whose bits one sector of the free map file holds.
+   The free map is read from disk a region of this many sectors
+   at a time, when allocation first needs it, so that mounting
+   does not read the whole map. */
+#define REGION_SECTORS (BLOCK_SECTOR_SIZE * 8)
+
+/* Regions read into FREE_MAP, one bit per region.  The bits of
+   other regions in FREE_MAP are not meaningful. */
+static struct bitmap *loaded;
+
+/* Number of free sectors, including those of regions not yet
+   loaded. */
+static size_t free_cnt;
+
+/* Sectors of the free map file that are out of date, one bit
+   per sector.  They are written by free_map_flush(). */
+static struct bitmap *dirty_sectors;
+
+/* A run of free sectors.
+   The free extents are an index of the sectors clear in
+   FREE_MAP, so that allocation does not scan the bitmap.  An
+   extent never crosses a region boundary.  Each extent is on two
+   lists: its region's, in order by first sector, and its size
+   class's, in no order.  Finding a run near a sector walks only
+   the extents of that sector's region, at most REGION_SECTORS / 2
+   of them, and finding a run of a given size looks at the front
+   of at most SIZE_CLASS_CNT size classes. */
+struct extent
+  {
+    block_sector_t start;               /* First free sector. */
+    size_t size;                        /* Number of free sectors. */
+    struct list_elem addr_elem;         /* Element in `region_extents'. */
+    struct list_elem size_elem;         /* Element in `size_classes'. */
+  };
+
+/* Free extents of each region, in order by first sector. */
+static struct list *region_extents;
+
+/* Size class N holds the free extents of 2**N to 2**(N+1) - 1
+   sectors.  Extents are at most REGION_SECTORS long, which is
+   2**12. */
+#define SIZE_CLASS_CNT 13
+static struct list size_classes[SIZE_CLASS_CNT];
+
+/* Protects the free map, the free extents, LOADED, FREE_CNT and
+   DIRTY_SECTORS. */
+static struct lock free_map_lock;
+
+static bool allocate_best_fit (size_t, block_sector_t *);
+static bool allocate_first_fit (block_sector_t, size_t, block_sector_t *);
+static bool find_first_fit (block_sector_t, size_t, size_t,
+                            block_sector_t *);
+static void load_regions (block_sector_t, size_t);
+static void load_region (size_t);
+static void add_region_extents (size_t);
+static bool mark_dirty (block_sector_t, size_t);
+static void make_available (block_sector_t, size_t);
+static void clear_extents (void);
+static void build_extents (void);
+static bool allocate (struct extent *, block_sector_t, size_t,
+                      block_sector_t *);
+static bool take_extent (struct extent *, block_sector_t, size_t);
+static void add_extent (block_sector_t, size_t);
+static void resize_extent (struct extent *, block_sector_t, size_t);
+static size_t size_class (size_t);
+
 /* Initializes the free map. */
 void
 free_map_init (void) 
 {
+  size_t i;
+
   free_map = bitmap_create (block_size (fs_device));
   if (free_map == NULL)
     PANIC ("bitmap creation failed--file system device is too large");
   bitmap_mark (free_map, FREE_MAP_SECTOR);
   bitmap_mark (free_map, ROOT_DIR_SECTOR);
+  bitmap_mark (free_map, SUPERBLOCK_SECTOR);
+  bitmap_set_multiple (free_map, JOURNAL_SECTOR, JOURNAL_SECTORS, true);
+  dirty_sectors = bitmap_create (DIV_ROUND_UP (bitmap_file_size (free_map),
+                                               BLOCK_SECTOR_SIZE));
+  loaded = bitmap_create (bitmap_size (dirty_sectors));
+  if (dirty_sectors == NULL || loaded == NULL)
+    PANIC ("bitmap creation failed--file system device is too large");
+  region_extents = malloc (bitmap_size (loaded) * sizeof *region_extents);
+  if (region_extents == NULL)
+    PANIC ("free extent allocation failed--file system device is too large");
+  for (i = 0; i < bitmap_size (loaded); i++)
+    list_init (&region_extents[i]);
+  for (i = 0; i < SIZE_CLASS_CNT; i++)
+    list_init (&size_classes[i]);
+  lock_init (&free_map_lock);
 }
 
 /* Allocates CNT consecutive sectors from the free map and stores
-   the first into *SECTORP.
+   the first into *SECTORP.  Chooses a run of free sectors from
+   the smallest size class that is sure to be large enough, to
+   keep large runs for large requests.  CNT may not exceed the
+   sectors of one region of the map.
+   The free map file is updated by free_map_flush().
    Returns true if successful, false if not enough consecutive
-   sectors were available or if the free_map file could not be
-   written. */
+   sectors were available or the running journal operation has no
+   room to log the change to the map. */
 bool
 free_map_allocate (size_t cnt, block_sector_t *sectorp)
 {
-  block_sector_t sector = bitmap_scan_and_flip (free_map, 0, cnt, false);
-  if (sector != BITMAP_ERROR
-      && free_map_file != NULL
-      && !bitmap_write (free_map, free_map_file))
-    {
-      bitmap_set_multiple (free_map, sector, cnt, false); 
-      sector = BITMAP_ERROR;
-    }
-  if (sector != BITMAP_ERROR)
-    *sectorp = sector;
-  return sector != BITMAP_ERROR;
+  bool success;
+
+  lock_acquire (&free_map_lock);
+  success = allocate_best_fit (cnt, sectorp);
+  lock_release (&free_map_lock);
+  return success;
 }
 
-/* Makes CNT sectors starting at SECTOR available for use. */
+/* Like free_map_allocate(), but places the CNT sectors at the
+   first free run at or after sector HINT, so that a file's data
+   lands close to its inode and to the rest of its data.  Falls
+   back to free_map_allocate() if there is no such run. */
+bool
+free_map_allocate_near (block_sector_t hint, size_t cnt,
+                        block_sector_t *sectorp)
+{
+  bool success;
+
+  lock_acquire (&free_map_lock);
+  success = (allocate_first_fit (hint, cnt, sectorp)
+             || allocate_best_fit (cnt, sectorp));
+  lock_release (&free_map_lock);
+  return success;
+}
+
+/* Makes CNT sectors starting at SECTOR available for use.
+   The free map file is updated by free_map_flush().  Inside a
+   journal operation, the sectors are only allocated again once
+   the transaction commits; see journal_free().  If the
+   running journal operation cannot log that update, which takes
+   freeing sectors in more regions of the map than the operation
+   and its transaction have room for, the sectors stay allocated
+   and are lost. */
 void
 free_map_release (block_sector_t sector, size_t cnt)
 {
+  lock_acquire (&free_map_lock);
+  load_regions (sector, cnt);
   ASSERT (bitmap_all (free_map, sector, cnt));
+  if (!mark_dirty (sector, cnt))
+    {
+      lock_release (&free_map_lock);
+      return;
+    }
   bitmap_set_multiple (free_map, sector, cnt, false);
-  bitmap_write (free_map, free_map_file);
+  if (!journal_free (sector, cnt))
+    make_available (sector, cnt);
+  lock_release (&free_map_lock);
+}
+
+/* Lets the CNT sectors starting at SECTOR, which were released
+   by a transaction that has since committed, be allocated
+   again. */
+void
+free_map_reuse (block_sector_t sector, size_t cnt)
+{
+  lock_acquire (&free_map_lock);
+  make_available (sector, cnt);
+  lock_release (&free_map_lock);
+}
+
+/* Adds the CNT sectors starting at SECTOR, which are clear in the
+   free map, to the free extents and the free count.
+   Must be called with free_map_lock held. */
+static void
+make_available (block_sector_t sector, size_t cnt) 
+{
+  block_sector_t end = sector + cnt;
+  block_sector_t start;
+
+  ASSERT (bitmap_none (free_map, sector, cnt));
+  for (start = sector; start < end; )
+    {
+      block_sector_t next_region = start / REGION_SECTORS + 1;
+      block_sector_t region_end = next_region * REGION_SECTORS;
+      block_sector_t piece_end = end < region_end ? end : region_end;
+      add_extent (start, piece_end - start);
+      start = piece_end;
+    }
+  free_cnt += cnt;
+}
+
+/* Returns the number of free sectors. */
+size_t
+free_map_free_cnt (void) 
+{
+  size_t cnt;
+
+  lock_acquire (&free_map_lock);
+  cnt = free_cnt;
+  lock_release (&free_map_lock);
+  return cnt;
 }
 
-/* Opens the free map file and reads it from disk. */
+/* Writes the sectors of the free map file that changed since the
+   last flush.  Called at the end of each file system operation
+   that may allocate or release sectors, so that the operation
+   writes each sector of the map it touched once, rather than the
+   whole map for every sector allocated. */
 void
-free_map_open (void) 
+free_map_flush (void) 
+{
+  size_t i;
+
+  /* Writing the file does not allocate, but flushes again; that
+     nested flush finds the lock held and leaves the rest of the
+     work to this one. */
+  if (free_map_file == NULL || lock_held_by_current_thread (&free_map_lock))
+    return;
+
+  lock_acquire (&free_map_lock);
+  journal_claim (bitmap_count (dirty_sectors, 0, bitmap_size (dirty_sectors),
+                               true));
+  while ((i = bitmap_scan_and_flip (dirty_sectors, 0, 1, true))
+         != BITMAP_ERROR)
+    if (!bitmap_write_part (free_map, free_map_file,
+                            i * BLOCK_SECTOR_SIZE, BLOCK_SECTOR_SIZE))
+      PANIC ("can't write free map");
+  lock_release (&free_map_lock);
+}
+
+/* Allocates CNT consecutive sectors from a free extent large
+   enough and stores the first into *SECTORP.  Takes the first
+   extent of the smallest size class whose extents all have at
+   least CNT sectors; failing that, the first extent large enough
+   in CNT's own class.  Only loaded regions are considered at
+   first; regions are loaded one by one until one of them
+   provides such an extent.
+   Returns true if successful, false if there is no such extent.
+   Must be called with free_map_lock held. */
+static bool
+allocate_best_fit (size_t cnt, block_sector_t *sectorp) 
+{
+  size_t first_class;
+
+  if (free_cnt < cnt || cnt == 0 || cnt > REGION_SECTORS)
+    return false;
+
+  first_class = size_class (cnt);
+  if (cnt != (size_t) 1 << first_class)
+    first_class++;
+
+  for (;;)
+    {
+      struct list_elem *e;
+      size_t region;
+      size_t class;
+
+      for (class = first_class; class < SIZE_CLASS_CNT; class++)
+        if (!list_empty (&size_classes[class]))
+          {
+            struct extent *x = list_entry (list_front (&size_classes[class]),
+                                           struct extent, size_elem);
+            return allocate (x, x->start, cnt, sectorp);
+          }
+
+      class = size_class (cnt);
+      for (e = list_begin (&size_classes[class]);
+           e != list_end (&size_classes[class]); e = list_next (e))
+        {
+          struct extent *x = list_entry (e, struct extent, size_elem);
+          if (x->size >= cnt)
+            return allocate (x, x->start, cnt, sectorp);
+        }
+
+      region = bitmap_scan (loaded, 0, 1, false);
+      if (region == BITMAP_ERROR)
+        return false;
+      load_region (region);
+    }
+}
+
+/* Allocates CNT consecutive sectors from the first free run at
+   or after sector HINT and stores the first into *SECTORP.
+   Loads the regions from HINT's on, one at a time, until the run
+   is found.
+   Returns true if successful, false if there is no such run.
+   Must be called with free_map_lock held. */
+static bool
+allocate_first_fit (block_sector_t hint, size_t cnt,
+                    block_sector_t *sectorp) 
+{
+  size_t region;
+
+  if (free_cnt < cnt)
+    return false;
+
+  for (region = hint / REGION_SECTORS; region < bitmap_size (loaded);
+       region++)
+    {
+      load_region (region);
+      if (find_first_fit (hint, region, cnt, sectorp))
+        return true;
+    }
+  return false;
+}
+
+/* Allocates CNT consecutive sectors from the first free run in
+   REGION that starts at or after sector HINT and stores the first
+   into *SECTORP.
+   Returns true if successful, false if there is no such run.
+   Must be called with free_map_lock held. */
+static bool
+find_first_fit (block_sector_t hint, size_t region, size_t cnt,
+                block_sector_t *sectorp) 
+{
+  struct list *extents = &region_extents[region];
+  struct list_elem *e;
+
+  for (e = list_begin (extents); e != list_end (extents); e = list_next (e))
+    {
+      struct extent *x = list_entry (e, struct extent, addr_elem);
+      block_sector_t end = x->start + x->size;
+      block_sector_t start = hint > x->start ? hint : x->start;
+      if (end > start && end - start >= cnt)
+        return allocate (x, start, cnt, sectorp);
+    }
+  return false;
+}
+
+/* Loads the regions holding the CNT sectors starting at
+   SECTOR. */
+static void
+load_regions (block_sector_t sector, size_t cnt) 
+{
+  size_t region;
+
+  for (region = sector / REGION_SECTORS;
+       region <= (sector + cnt - 1) / REGION_SECTORS; region++)
+    load_region (region);
+}
+
+/* Reads REGION of the free map from the free map file, unless it
+   is loaded already, and adds its free sectors to the free
+   extents.
+   Must be called with free_map_lock held. */
+static void
+load_region (size_t region) 
+{
+  if (bitmap_test (loaded, region))
+    return;
+  if (!bitmap_read_part (free_map, free_map_file, region * BLOCK_SECTOR_SIZE,
+                         BLOCK_SECTOR_SIZE))
+    PANIC ("can't read free map");
+  bitmap_mark (loaded, region);
+  add_region_extents (region);
+}
+
+/* Adds the sectors of REGION clear in the free map to the free
+   extents.
+   Must be called with free_map_lock held. */
+static void
+add_region_extents (size_t region) 
+{
+  size_t start, end, region_end;
+
+  region_end = (region + 1) * REGION_SECTORS;
+  if (region_end > bitmap_size (free_map))
+    region_end = bitmap_size (free_map);
+  for (start = region * REGION_SECTORS; start < region_end; start = end)
+    {
+      start = bitmap_scan (free_map, start, 1, false);
+      if (start == BITMAP_ERROR || start >= region_end)
+        break;
+      end = bitmap_scan (free_map, start, 1, true);
+      if (end == BITMAP_ERROR || end > region_end)
+        end = region_end;
+      add_extent (start, end - start);
+    }
+}
+
+/* Marks the sectors of the free map file holding the bits for the
+   CNT sectors starting at SECTOR as out of date, setting aside a
+   journal credit for each one that was not already, so that
+   free_map_flush() can log it.  Returns false if the journal has
+   no room for one of them. */
+static bool
+mark_dirty (block_sector_t sector, size_t cnt) 
+{
+  size_t first = sector / REGION_SECTORS;
+  size_t last = (sector + cnt - 1) / REGION_SECTORS;
+  size_t i;
+
+  for (i = first; i <= last; i++)
+    if (!bitmap_test (dirty_sectors, i))
+      {
+        /* Before free_map_create() publishes the file, the map
+           is written whole rather than flushed. */
+        if (free_map_file != NULL && !journal_charge ())
+          return false;
+        bitmap_mark (dirty_sectors, i);
+      }
+  return true;
+}
+
+/* Takes the CNT sectors starting at START, which lie within free
+   extent X, and marks them in the free map.  Stores START into
+   *SECTORP and returns true, or returns false if the journal has
+   no room to log the change to the map. */
+static bool
+allocate (struct extent *x, block_sector_t start, size_t cnt,
+          block_sector_t *sectorp) 
+{
+  /* X lies in one region, so any sectors of it have the same
+     sector of the map. */
+  if (!mark_dirty (start, cnt))
+    return false;
+
+  /* Splitting X needs memory; take its beginning instead if
+     none is left. */
+  if (!take_extent (x, start, cnt))
+    {
+      start = x->start;
+      take_extent (x, start, cnt);
+    }
+
+  ASSERT (bitmap_none (free_map, start, cnt));
+  bitmap_set_multiple (free_map, start, cnt, true);
+  free_cnt -= cnt;
+  *sectorp = start;
+  return true;
+}
+
+/* Removes the CNT sectors starting at START from free extent X,
+   which contains them.  Returns false without changing anything
+   if X would have to be split in two but memory is short. */
+static bool
+take_extent (struct extent *x, block_sector_t start, size_t cnt) 
+{
+  block_sector_t end = start + cnt;
+  block_sector_t x_end = x->start + x->size;
+
+  ASSERT (start >= x->start && end <= x_end);
+
+  if (start > x->start && end < x_end)
+    {
+      struct extent *tail = malloc (sizeof *tail);
+      if (tail == NULL)
+        return false;
+      tail->start = end;
+      tail->size = x_end - end;
+      list_insert (list_next (&x->addr_elem), &tail->addr_elem);
+      list_push_back (&size_classes[size_class (tail->size)],
+                      &tail->size_elem);
+      resize_extent (x, x->start, start - x->start);
+    }
+  else if (start > x->start)
+    resize_extent (x, x->start, start - x->start);
+  else
+    resize_extent (x, end, x_end - end);
+  return true;
+}
+
+/* Adds the CNT sectors starting at START, which lie in one
+   region, to the free extents, merging them with the extents next
+   to them in that region.  If memory is short, the sectors are
+   only free in the bitmap until the extents are next built from
+   it. */
+static void
+add_extent (block_sector_t start, size_t cnt) 
+{
+  struct list *extents = &region_extents[start / REGION_SECTORS];
+  struct extent *prev = NULL, *next = NULL, *x;
+  struct list_elem *e;
+
+  ASSERT ((start + cnt - 1) / REGION_SECTORS == start / REGION_SECTORS);
+
+  for (e = list_begin (extents); e != list_end (extents); e = list_next (e))
+    {
+      next = list_entry (e, struct extent, addr_elem);
+      if (next->start > start)
+        break;
+      prev = next;
+      next = NULL;
+    }
+
+  if (prev != NULL && prev->start + prev->size == start)
+    {
+      if (next != NULL && start + cnt == next->start)
+        {
+          cnt += next->size;
+          resize_extent (next, next->start, 0);
+        }
+      resize_extent (prev, prev->start, prev->size + cnt);
+    }
+  else if (next != NULL && start + cnt == next->start)
+    resize_extent (next, start, next->size + cnt);
+  else
+    {
+      x = malloc (sizeof *x);
+      if (x == NULL)
+        return;
+      x->start = start;
+      x->size = cnt;
+      list_insert (e, &x->addr_elem);
+      list_push_back (&size_classes[size_class (cnt)], &x->size_elem);
+    }
+}
+
+/* Makes free extent X cover the SIZE sectors starting at START,
+   moving it to the size class of SIZE, or frees X if SIZE is 0. */
+static void
+resize_extent (struct extent *x, block_sector_t start, size_t size) 
+{
+  list_remove (&x->size_elem);
+  if (size == 0)
+    {
+      list_remove (&x->addr_elem);
+      free (x);
+      return;
+    }
+  x->start = start;
+  x->size = size;
+  list_push_back (&size_classes[size_class (size)], &x->size_elem);
+}
+
+/* Frees all the free extents. */
+static void
+clear_extents (void) 
+{
+  size_t i;
+
+  for (i = 0; i < bitmap_size (loaded); i++)
+    while (!list_empty (&region_extents[i]))
+      {
+        struct list_elem *e = list_pop_front (&region_extents[i]);
+        free (list_entry (e, struct extent, addr_elem));
+      }
+  for (i = 0; i < SIZE_CLASS_CNT; i++)
+    list_init (&size_classes[i]);
+}
+
+/* Rebuilds the free extents from the whole free map. */
+static void
+build_extents (void) 
+{
+  size_t region;
+
+  clear_extents ();
+  for (region = 0; region < bitmap_size (loaded); region++)
+    add_region_extents (region);
+}
+
+/* Returns the size class of free extents of SIZE sectors, the
+   base-2 logarithm of SIZE rounded down. */
+static size_t
+size_class (size_t size) 
+{
+  size_t class = 0;
+
+  ASSERT (size > 0 && size <= REGION_SECTORS);
+  while (size >>= 1)
+    class++;
+  return class;
+}
+
+/* Opens the free map file.  If LAZY is true, CNT is the
+   number of free sectors on disk and each region of the map is
+   read from disk when first needed; otherwise, the whole map is
+   read now and its free sectors counted. */
+void
+free_map_open (bool lazy, size_t cnt) 
 {
   free_map_file = file_open (inode_open (FREE_MAP_SECTOR));
   if (free_map_file == NULL)
     PANIC ("can't open free map");
-  if (!bitmap_read (free_map, free_map_file))
-    PANIC ("can't read free map");
+
+  lock_acquire (&free_map_lock);
+  if (lazy)
+    {
+      clear_extents ();
+      bitmap_set_all (loaded, false);
+      free_cnt = cnt;
+    }
+  else
+    {
+      if (!bitmap_read (free_map, free_map_file))
+        PANIC ("can't read free map");
+      build_extents ();
+      bitmap_set_all (loaded, true);
+      free_cnt = bitmap_count (free_map, 0, bitmap_size (free_map), false);
+    }
+  lock_release (&free_map_lock);
 }
 
 /* Writes the free map to disk and closes the free map file. */
 void
 free_map_close (void) 
 {
+  free_map_flush ();
   file_close (free_map_file);
+  free_map_file = NULL;
 }
 
 /* Creates a new free map file on disk and writes the free map to
-   it. */
+   it.  Must not be called inside a journal operation, since the
+   map may be too large for one; the file is written a journal
+   operation per sector. */
 void
 free_map_create (void) 
 {
+  struct file *file;
+
+  build_extents ();
+  bitmap_set_all (loaded, true);
+  free_cnt = bitmap_count (free_map, 0, bitmap_size (free_map), false);
+
   /* Create inode. */
-  if (!inode_create (FREE_MAP_SECTOR, bitmap_file_size (free_map)))
+  if (!inode_create (FREE_MAP_SECTOR, bitmap_file_size (free_map), false))
     PANIC ("free map creation failed");
 
-  /* Write bitmap to file. */
-  free_map_file = file_open (inode_open (FREE_MAP_SECTOR));
-  if (free_map_file == NULL)
+  /* Write bitmap to file.  The first write allocates the file's
+     sectors, which must not write the free map themselves while
+     it is incomplete, so the file is only published after it.
+     The second write covers the whole map, so it leaves nothing
+     for free_map_flush() to write. */
+  file = file_open (inode_open (FREE_MAP_SECTOR));
+  if (file == NULL)
     PANIC ("can't open free map");
+  if (!bitmap_write (free_map, file))
+    PANIC ("can't write free map");
+  free_map_file = file;
+  bitmap_set_all (dirty_sectors, false);
   if (!bitmap_write (free_map, free_map_file))
     PANIC ("can't write free map");
 }
@@ -8,10 +8,14 @@
 void free_map_init (void);
 void free_map_read (void);
 void free_map_create (void);
-void free_map_open (void);
+void free_map_open (bool lazy, size_t cnt);
 void free_map_close (void);
+void free_map_flush (void);
 
 bool free_map_allocate (size_t, block_sector_t *);
+bool free_map_allocate_near (block_sector_t hint, size_t, block_sector_t *);
 void free_map_release (block_sector_t, size_t);
+void free_map_reuse (block_sector_t, size_t);
+size_t free_map_free_cnt (void);
 
 #endif /* filesys/free-map.h */
@@ -1,23 +1,61 @@
 #include "filesys/inode.h"
-#include <list.h>
 #include <debug.h>
+#include <hash.h>
 #include <round.h>
 #include <string.h>
+#include "filesys/cache.h"
 #include "filesys/filesys.h"
 #include "filesys/free-map.h"
+#include "filesys/journal.h"
 #include "threads/malloc.h"
+#include "threads/synch.h"
 
 /* Identifies an inode. */
 #define INODE_MAGIC 0x494e4f44
 
+/* Sector numbers in an index block. */
+#define PTRS_PER_SECTOR (BLOCK_SECTOR_SIZE / sizeof (block_sector_t))
+
+/* Entries of an on-disk inode's BLOCKS.  The first DIRECT_CNT
+   refer to data sectors, the next to an indirect block of data
+   sectors, the last to a doubly indirect block of indirect
+   blocks. */
+#define DIRECT_CNT 123
+#define INDIRECT_IDX DIRECT_CNT
+#define DBL_INDIRECT_IDX (DIRECT_CNT + 1)
+#define BLOCK_CNT (DIRECT_CNT + 2)
+
+/* Reads of regular files at least this long bypass the cache
+   for their whole sectors.  See inode_read_at(). */
+#define DIRECT_READ_MIN (4 * BLOCK_SECTOR_SIZE)
+
+/* Writes to a regular file are split into journal operations of
+   at most this many bytes, aligned to multiples of it.  Such an
+   operation logs the inode, up to 3 index blocks and a free map
+   sector for each of the up to 11 sectors it allocates, which is
+   within JOURNAL_OP_MAX.  Writes to metadata, whose data is
+   logged too, are split into single sectors. */
+#define WRITE_PIECE (8 * BLOCK_SECTOR_SIZE)
+
+/* Sectors released per journal operation when a removed inode's
+   blocks are freed.  Each may dirty a sector of the free map. */
+#define RELEASE_BATCH 8
+
+/* Most data sectors in a file. */
+#define MAX_SECTORS (DIRECT_CNT + PTRS_PER_SECTOR \
+                     + PTRS_PER_SECTOR * PTRS_PER_SECTOR)
+
 /* On-disk inode.
-   Must be exactly BLOCK_SECTOR_SIZE bytes long. */
+   Must be exactly BLOCK_SECTOR_SIZE bytes long.
+   Sector 0 holds the free map's inode, so it never appears in an
+   index and stands for "no sector". */
 struct inode_disk
   {
-    block_sector_t start;               /* First data sector. */
     off_t length;                       /* File size in bytes. */
     unsigned magic;                     /* Magic number. */
-    uint32_t unused[125];               /* Not used. */
+    bool is_dir;                        /* Directory or ordinary file? */
+    uint8_t unused[3];                  /* Not used. */
+    block_sector_t blocks[BLOCK_CNT];   /* Data and index sectors. */
   };
 
 /* Returns the number of sectors to allocate for an inode SIZE
@@ -28,49 +66,291 @@ bytes_to_sectors (off_t size)
   return DIV_ROUND_UP (size, BLOCK_SECTOR_SIZE);
 }
 
-/* In-memory inode. */
+/* In-memory inode.
+   OPEN_CNT and LOADING are protected by `open_inodes_lock', the
+   rest by
+   RWLOCK, which readers of the data hold for reading and
+   anything that changes DATA or DENY_WRITE_CNT holds for
+   writing. */
 struct inode 
   {
-    struct list_elem elem;              /* Element in inode list. */
+    struct hash_elem elem;              /* Element in `open_inodes'. */
     block_sector_t sector;              /* Sector number of disk location. */
     int open_cnt;                       /* Number of openers. */
+    bool loading;                       /* DATA still being read? */
     bool removed;                       /* True if deleted, false otherwise. */
     int deny_write_cnt;                 /* 0: writes ok, >0: deny writes. */
+    struct rwlock rwlock;               /* Protects the inode's data. */
+    struct lock dir_lock;               /* See inode_lock(). */
+    int cursor_cnt;                     /* See inode_open_cursor(). */
     struct inode_disk data;             /* Inode content. */
   };
 
+/* Returns true if INODE's data is file system metadata, that is,
+   if INODE is a directory or the free map.  Metadata is written
+   through the journal; the data of ordinary files is not. */
+static bool
+is_metadata (const struct inode *inode) 
+{
+  return inode->data.is_dir || inode->sector == FREE_MAP_SECTOR;
+}
+
+/* Writes SIZE bytes from BUFFER starting at byte OFS of SECTOR,
+   through the journal if META is true.  Returns false if the
+   journal operation has no room for SECTOR. */
+static bool
+write_sector (block_sector_t sector, const void *buffer, int ofs, int size,
+              bool meta) 
+{
+  if (meta)
+    return journal_write (sector, buffer, ofs, size);
+  cache_write (sector, buffer, ofs, size);
+  return true;
+}
+
+/* Allocates a sector for INODE, as close after the inode as
+   possible, fills it with zeros, and stores it into *SECTORP.
+   The sector is an index block unless DATA is true.  A data
+   sector of an ordinary file is written to disk before the
+   allocation commits.
+   Returns true if successful, false if the disk is full or the
+   journal operation has no room left. */
+static bool
+allocate_sector (struct inode *inode, block_sector_t *sectorp, bool data) 
+{
+  static char zeros[BLOCK_SECTOR_SIZE];
+  bool meta = !data || is_metadata (inode);
+
+  if (!free_map_allocate_near (inode->sector, 1, sectorp))
+    return false;
+  if (!write_sector (*sectorp, zeros, 0, BLOCK_SECTOR_SIZE, meta))
+    {
+      free_map_release (*sectorp, 1);
+      return false;
+    }
+  if (!meta)
+    journal_order (*sectorp);
+  return true;
+}
+
+/* Returns the sector that entry I of INODE's blocks refers to.
+   If there is none and ALLOCATE is true, allocates a zeroed
+   sector for it and writes INODE back.
+   Returns 0 if there is no such sector. */
+static block_sector_t
+inode_entry (struct inode *inode, size_t i, bool allocate) 
+{
+  block_sector_t *sectorp = &inode->data.blocks[i];
+
+  if (*sectorp == 0 && allocate
+      && allocate_sector (inode, sectorp, i < DIRECT_CNT)
+      && !journal_write (inode->sector, &inode->data, 0, BLOCK_SECTOR_SIZE))
+    {
+      free_map_release (*sectorp, 1);
+      *sectorp = 0;
+    }
+  return *sectorp;
+}
+
+/* Returns the sector that entry I of INODE's index block INDEX
+   refers to, allocating a zeroed one if there is none and
+   ALLOCATE is true.  The sector is an index block unless DATA is
+   true.  Returns 0 if there is no such sector. */
+static block_sector_t
+index_entry (struct inode *inode, block_sector_t index, size_t i,
+             bool allocate, bool data) 
+{
+  block_sector_t sector;
+
+  cache_read (index, &sector, i * sizeof sector, sizeof sector);
+  if (sector == 0 && allocate && allocate_sector (inode, &sector, data)
+      && !journal_write (index, &sector, i * sizeof sector, sizeof sector))
+    {
+      free_map_release (sector, 1);
+      sector = 0;
+    }
+  return sector;
+}
+
+/* Returns the sector holding data sector IDX of INODE, going
+   through the index blocks.  If ALLOCATE is true, allocates the
+   missing data and index sectors along the way.  Returns 0 if
+   there is no such sector, that is, for a hole in the file, or
+   if the disk is full or the journal operation has no room
+   left. */
+static block_sector_t
+lookup_sector (struct inode *inode, size_t idx, bool allocate) 
+{
+  block_sector_t index;
+
+  ASSERT (idx < MAX_SECTORS);
+
+  if (idx < DIRECT_CNT)
+    return inode_entry (inode, idx, allocate);
+  idx -= DIRECT_CNT;
+
+  if (idx < PTRS_PER_SECTOR)
+    {
+      index = inode_entry (inode, INDIRECT_IDX, allocate);
+      return index != 0 ? index_entry (inode, index, idx, allocate, true) : 0;
+    }
+  idx -= PTRS_PER_SECTOR;
+
+  index = inode_entry (inode, DBL_INDIRECT_IDX, allocate);
+  if (index != 0)
+    index = index_entry (inode, index, idx / PTRS_PER_SECTOR, allocate,
+                         false);
+  if (index != 0)
+    index = index_entry (inode, index, idx % PTRS_PER_SECTOR, allocate,
+                         true);
+  return index;
+}
+
+/* Frees data sector IDX of INODE, if it has one, and clears the
+   entry that refers to it.  Returns false if the journal
+   operation has no room to log the entry. */
+static bool
+clear_sector (struct inode *inode, size_t idx) 
+{
+  static const block_sector_t no_sector = 0;
+  block_sector_t index, sector;
+
+  ASSERT (idx < MAX_SECTORS);
+
+  if (idx < DIRECT_CNT)
+    {
+      sector = inode->data.blocks[idx];
+      if (sector == 0)
+        return true;
+      inode->data.blocks[idx] = 0;
+      if (!journal_write (inode->sector, &inode->data, 0, BLOCK_SECTOR_SIZE))
+        {
+          inode->data.blocks[idx] = sector;
+          return false;
+        }
+      free_map_release (sector, 1);
+      return true;
+    }
+  idx -= DIRECT_CNT;
+
+  if (idx < PTRS_PER_SECTOR)
+    index = inode->data.blocks[INDIRECT_IDX];
+  else
+    {
+      idx -= PTRS_PER_SECTOR;
+      index = inode->data.blocks[DBL_INDIRECT_IDX];
+      if (index != 0)
+        index = index_entry (inode, index, idx / PTRS_PER_SECTOR, false,
+                             false);
+      idx %= PTRS_PER_SECTOR;
+    }
+  if (index == 0)
+    return true;
+
+  cache_read (index, &sector, idx * sizeof sector, sizeof sector);
+  if (sector == 0)
+    return true;
+  if (!journal_write (index, &no_sector, idx * sizeof sector, sizeof sector))
+    return false;
+  free_map_release (sector, 1);
+  return true;
+}
+
+/* Releases SECTOR, counting it in *CNT.  Every RELEASE_BATCH
+   sectors, ends the journal operation and starts another, unless
+   it is nested in a larger one. */
+static void
+release (block_sector_t sector, size_t *cnt) 
+{
+  free_map_release (sector, 1);
+  if (++*cnt % RELEASE_BATCH == 0)
+    {
+      free_map_flush ();
+      journal_end ();
+      journal_begin ();
+    }
+}
+
+/* Releases SECTOR and, if it is an index block of LEVEL levels
+   above the data, every sector it refers to, counting them in
+   *CNT. */
+static void
+release_sector (block_sector_t sector, int level, size_t *cnt) 
+{
+  if (level > 0)
+    {
+      size_t i;
+
+      for (i = 0; i < PTRS_PER_SECTOR; i++)
+        {
+          block_sector_t entry;
+
+          cache_read (sector, &entry, i * sizeof entry, sizeof entry);
+          if (entry != 0)
+            release_sector (entry, level - 1, cnt);
+        }
+    }
+  release (sector, cnt);
+}
+
+/* Releases every data and index sector of DISK_INODE, counting
+   them in *CNT. */
+static void
+release_blocks (struct inode_disk *disk_inode, size_t *cnt) 
+{
+  size_t i;
+
+  for (i = 0; i < BLOCK_CNT; i++)
+    if (disk_inode->blocks[i] != 0)
+      release_sector (disk_inode->blocks[i],
+                      i < DIRECT_CNT ? 0 : i == INDIRECT_IDX ? 1 : 2, cnt);
+}
+
 /* Returns the block device sector that contains byte offset POS
-   within INODE.
+   within INODE, or 0 if POS falls in a hole, which reads as zeros.
    Returns -1 if INODE does not contain data for a byte at offset
    POS. */
 static block_sector_t
-byte_to_sector (const struct inode *inode, off_t pos) 
+byte_to_sector (struct inode *inode, off_t pos) 
 {
   ASSERT (inode != NULL);
   if (pos < inode->data.length)
-    return inode->data.start + pos / BLOCK_SECTOR_SIZE;
+    return lookup_sector (inode, pos / BLOCK_SECTOR_SIZE, false);
   else
     return -1;
 }
 
-/* List of open inodes, so that opening a single inode twice
+/* Open inodes, by sector, so that opening a single inode twice
    returns the same `struct inode'. */
-static struct list open_inodes;
+static struct hash open_inodes;
+static struct lock open_inodes_lock;
+static struct condition inode_loaded;  /* Signaled when DATA is read. */
+
+static hash_hash_func inode_hash;
+static hash_less_func inode_less;
+static off_t write_piece (struct inode *, const uint8_t *, off_t size,
+                          off_t offset);
 
 /* Initializes the inode module. */
 void
 inode_init (void) 
 {
-  list_init (&open_inodes);
+  lock_init (&open_inodes_lock);
+  cond_init (&inode_loaded);
+  if (!hash_init (&open_inodes, inode_hash, inode_less, NULL))
+    PANIC ("out of memory allocating open inode table");
 }
 
-/* Initializes an inode with LENGTH bytes of data and
-   writes the new inode to sector SECTOR on the file system
-   device.
+/* Initializes an inode with LENGTH bytes of data, for a
+   directory if IS_DIR is true, and writes the new inode to
+   sector SECTOR on the file system device.  The data is a hole
+   that reads as zeros; sectors are only allocated when first
+   written.
    Returns true if successful.
-   Returns false if memory or disk allocation fails. */
+   Returns false if memory allocation fails, LENGTH is too large,
+   or the journal operation has no room left. */
 bool
-inode_create (block_sector_t sector, off_t length)
+inode_create (block_sector_t sector, off_t length, bool is_dir)
 {
   struct inode_disk *disk_inode = NULL;
   bool success = false;
@@ -81,25 +361,18 @@ inode_create (block_sector_t sector, off_t length)
      one sector in size, and you should fix that. */
   ASSERT (sizeof *disk_inode == BLOCK_SECTOR_SIZE);
 
+  if (bytes_to_sectors (length) > MAX_SECTORS)
+    return false;
+
   disk_inode = calloc (1, sizeof *disk_inode);
   if (disk_inode != NULL)
     {
-      size_t sectors = bytes_to_sectors (length);
       disk_inode->length = length;
       disk_inode->magic = INODE_MAGIC;
-      if (free_map_allocate (sectors, &disk_inode->start)) 
-        {
-          block_write (fs_device, sector, disk_inode);
-          if (sectors > 0) 
-            {
-              static char zeros[BLOCK_SECTOR_SIZE];
-              size_t i;
-              
-              for (i = 0; i < sectors; i++) 
-                block_write (fs_device, disk_inode->start + i, zeros);
-            }
-          success = true; 
-        } 
+      disk_inode->is_dir = is_dir;
+      journal_begin ();
+      success = journal_write (sector, disk_inode, 0, BLOCK_SECTOR_SIZE);
+      journal_end ();
       free (disk_inode);
     }
   return success;
@@ -111,33 +384,53 @@ inode_create (block_sector_t sector, off_t length)
 struct inode *
 inode_open (block_sector_t sector)
 {
-  struct list_elem *e;
+  struct inode key;
+  struct hash_elem *e;
   struct inode *inode;
 
+  lock_acquire (&open_inodes_lock);
+
   /* Check whether this inode is already open. */
-  for (e = list_begin (&open_inodes); e != list_end (&open_inodes);
-       e = list_next (e)) 
+  key.sector = sector;
+  e = hash_find (&open_inodes, &key.elem);
+  if (e != NULL)
     {
-      inode = list_entry (e, struct inode, elem);
-      if (inode->sector == sector) 
-        {
-          inode_reopen (inode);
-          return inode; 
-        }
+      inode = hash_entry (e, struct inode, elem);
+      inode->open_cnt++;
+      while (inode->loading)
+        cond_wait (&inode_loaded, &open_inodes_lock);
+      lock_release (&open_inodes_lock);
+      return inode;
     }
 
   /* Allocate memory. */
   inode = malloc (sizeof *inode);
   if (inode == NULL)
-    return NULL;
+    {
+      lock_release (&open_inodes_lock);
+      return NULL;
+    }
 
-  /* Initialize. */
-  list_push_front (&open_inodes, &inode->elem);
+  /* Initialize.  The inode is read with the table unlocked, so
+     that other opens need not wait for the disk; anyone who finds
+     it meanwhile waits until it is loaded. */
   inode->sector = sector;
+  hash_insert (&open_inodes, &inode->elem);
   inode->open_cnt = 1;
+  inode->loading = true;
   inode->deny_write_cnt = 0;
   inode->removed = false;
-  block_read (fs_device, inode->sector, &inode->data);
+  rwlock_init (&inode->rwlock);
+  lock_init (&inode->dir_lock);
+  inode->cursor_cnt = 0;
+  lock_release (&open_inodes_lock);
+
+  cache_read (inode->sector, &inode->data, 0, BLOCK_SECTOR_SIZE);
+
+  lock_acquire (&open_inodes_lock);
+  inode->loading = false;
+  cond_broadcast (&inode_loaded, &open_inodes_lock);
+  lock_release (&open_inodes_lock);
   return inode;
 }
 
@@ -146,7 +439,11 @@ struct inode *
 inode_reopen (struct inode *inode)
 {
   if (inode != NULL)
-    inode->open_cnt++;
+    {
+      lock_acquire (&open_inodes_lock);
+      inode->open_cnt++;
+      lock_release (&open_inodes_lock);
+    }
   return inode;
 }
 
@@ -159,7 +456,10 @@ inode_get_inumber (const struct inode *inode)
 
 /* Closes INODE and writes it to disk.
    If this was the last reference to INODE, frees its memory.
-   If INODE was also a removed inode, frees its blocks. */
+   If INODE was also a removed inode, frees its blocks, in several
+   journal operations unless called inside one.  A crash part way
+   through only leaves some of them allocated, since nothing
+   refers to them any more. */
 void
 inode_close (struct inode *inode) 
 {
@@ -168,21 +468,46 @@ inode_close (struct inode *inode)
     return;
 
   /* Release resources if this was the last opener. */
-  if (--inode->open_cnt == 0)
+  lock_acquire (&open_inodes_lock);
+  if (--inode->open_cnt > 0)
     {
-      /* Remove from inode list and release lock. */
-      list_remove (&inode->elem);
- 
-      /* Deallocate blocks if removed. */
-      if (inode->removed) 
-        {
-          free_map_release (inode->sector, 1);
-          free_map_release (inode->data.start,
-                            bytes_to_sectors (inode->data.length)); 
-        }
+      lock_release (&open_inodes_lock);
+      return;
+    }
+
+  /* Remove from table of open inodes.  No one else refers to
+     INODE any more. */
+  hash_delete (&open_inodes, &inode->elem);
+  lock_release (&open_inodes_lock);
 
-      free (inode); 
+  /* Deallocate blocks if removed. */
+  if (inode->removed) 
+    {
+      size_t cnt = 0;
+
+      journal_begin ();
+      release (inode->sector, &cnt);
+      release_blocks (&inode->data, &cnt);
+      free_map_flush ();
+      journal_end ();
     }
+
+  free (inode); 
+}
+
+/* Returns true if INODE is a directory. */
+bool
+inode_is_dir (const struct inode *inode) 
+{
+  return inode->data.is_dir;
+}
+
+/* Returns true if INODE has been removed, so that it disappears
+   once closed. */
+bool
+inode_is_removed (const struct inode *inode) 
+{
+  return inode->removed;
 }
 
 /* Marks INODE to be deleted when it is closed by the last caller who
@@ -191,10 +516,60 @@ void
 inode_remove (struct inode *inode) 
 {
   ASSERT (inode != NULL);
+  rwlock_acquire_write (&inode->rwlock);
   inode->removed = true;
+  rwlock_release_write (&inode->rwlock);
+}
+
+/* Acquires INODE's directory lock.  directory.c holds it across
+   each operation on the entries of INODE, a directory, so that
+   lookups and changes see the directory as a whole; reading and
+   writing the entries takes INODE's data lock on top of it. */
+void
+inode_lock (struct inode *inode) 
+{
+  lock_acquire (&inode->dir_lock);
+}
+
+/* Releases INODE's directory lock. */
+void
+inode_unlock (struct inode *inode) 
+{
+  lock_release (&inode->dir_lock);
+}
+
+/* Notes that a walk of the entries of INODE, a directory, has
+   started, which directory.c uses to hold off moving entries
+   around under it.  Must be called with INODE's directory lock
+   held, like inode_close_cursor() and inode_has_cursors(). */
+void
+inode_open_cursor (struct inode *inode) 
+{
+  ASSERT (lock_held_by_current_thread (&inode->dir_lock));
+  inode->cursor_cnt++;
+}
+
+/* Notes that a walk started with inode_open_cursor() is over. */
+void
+inode_close_cursor (struct inode *inode) 
+{
+  ASSERT (lock_held_by_current_thread (&inode->dir_lock));
+  ASSERT (inode->cursor_cnt > 0);
+  inode->cursor_cnt--;
+}
+
+/* Returns true if a walk of INODE's entries is in progress. */
+bool
+inode_has_cursors (const struct inode *inode) 
+{
+  return inode->cursor_cnt > 0;
 }
 
 /* Reads SIZE bytes from INODE into BUFFER, starting at position OFFSET.
+   A read of a regular file at least DIRECT_READ_MIN bytes long
+   goes through the cache only for its partial first and last
+   sectors; the whole sectors in between are read straight into
+   BUFFER, a run of sectors contiguous on disk at a time.
    Returns the number of bytes actually read, which may be less
    than SIZE if an error occurs or end of file is reached. */
 off_t
@@ -202,8 +577,9 @@ inode_read_at (struct inode *inode, void *buffer_, off_t size, off_t offset)
 {
   uint8_t *buffer = buffer_;
   off_t bytes_read = 0;
-  uint8_t *bounce = NULL;
+  bool direct = size >= DIRECT_READ_MIN && !is_metadata (inode);
 
+  rwlock_acquire_read (&inode->rwlock);
   while (size > 0) 
     {
       /* Disk sector to read, starting byte offset within sector. */
@@ -220,100 +596,194 @@ inode_read_at (struct inode *inode, void *buffer_, off_t size, off_t offset)
       if (chunk_size <= 0)
         break;
 
-      if (sector_ofs == 0 && chunk_size == BLOCK_SECTOR_SIZE)
+      if (sector_idx == 0)
+        memset (buffer + bytes_read, 0, chunk_size);
+      else if (direct && chunk_size == BLOCK_SECTOR_SIZE)
         {
-          /* Read full sector directly into caller's buffer. */
-          block_read (fs_device, sector_idx, buffer + bytes_read);
-        }
-      else 
-        {
-          /* Read sector into bounce buffer, then partially copy
-             into caller's buffer. */
-          if (bounce == NULL) 
+          /* Extend the chunk over the whole sectors after it
+             that are also next to it on disk. */
+          size_t cnt = 1;
+          while (size - chunk_size >= BLOCK_SECTOR_SIZE
+                 && inode_left - chunk_size >= BLOCK_SECTOR_SIZE
+                 && (byte_to_sector (inode, offset + chunk_size)
+                     == sector_idx + cnt))
             {
-              bounce = malloc (BLOCK_SECTOR_SIZE);
-              if (bounce == NULL)
-                break;
+              chunk_size += BLOCK_SECTOR_SIZE;
+              cnt++;
             }
-          block_read (fs_device, sector_idx, bounce);
-          memcpy (buffer + bytes_read, bounce + sector_ofs, chunk_size);
+          cache_read_direct (sector_idx, cnt, buffer + bytes_read);
         }
+      else
+        cache_read (sector_idx, buffer + bytes_read, sector_ofs, chunk_size);
       
       /* Advance. */
       size -= chunk_size;
       offset += chunk_size;
       bytes_read += chunk_size;
     }
-  free (bounce);
+  rwlock_release_read (&inode->rwlock);
 
   return bytes_read;
 }
 
+/* Asks for the sectors holding SIZE bytes of INODE starting at
+   OFFSET to be read into the cache in the background, ahead of a
+   sequential reader.  Holes and sectors past the end of the
+   file are ignored. */
+void
+inode_read_ahead (struct inode *inode, off_t size, off_t offset) 
+{
+  off_t end = offset + size;
+
+  rwlock_acquire_read (&inode->rwlock);
+  if (end > inode_length (inode))
+    end = inode_length (inode);
+  for (offset = ROUND_DOWN (offset, BLOCK_SECTOR_SIZE); offset < end;
+       offset += BLOCK_SECTOR_SIZE)
+    {
+      block_sector_t sector = byte_to_sector (inode, offset);
+      if (sector != 0)
+        cache_read_ahead (sector);
+    }
+  rwlock_release_read (&inode->rwlock);
+}
+
+/* Frees the sectors holding the SIZE bytes of INODE starting at
+   OFFSET, which must both be multiples of BLOCK_SECTOR_SIZE, so
+   that they become a hole that reads as zeros.  Index blocks stay
+   allocated.  The sectors are freed in one journal operation.
+   Returns true if successful, false if the operation ran out of
+   room, in which case only some of the sectors may be freed. */
+bool
+inode_punch_hole (struct inode *inode, off_t size, off_t offset) 
+{
+  bool success = true;
+
+  ASSERT (size % BLOCK_SECTOR_SIZE == 0 && offset % BLOCK_SECTOR_SIZE == 0);
+
+  journal_begin ();
+  rwlock_acquire_write (&inode->rwlock);
+  for (; success && size > 0; size -= BLOCK_SECTOR_SIZE)
+    {
+      success = clear_sector (inode, offset / BLOCK_SECTOR_SIZE);
+      offset += BLOCK_SECTOR_SIZE;
+    }
+  rwlock_release_write (&inode->rwlock);
+  free_map_flush ();
+  journal_end ();
+  return success;
+}
+
 /* Writes SIZE bytes from BUFFER into INODE, starting at OFFSET.
+   Writing past end of file extends INODE, leaving a hole between
+   the old end and OFFSET.  Sectors are allocated as they are
+   first written.
+   The write is split into journal operations of at most
+   WRITE_PIECE bytes, so that a crash may leave a long write
+   partly done.
    Returns the number of bytes actually written, which may be
-   less than SIZE if end of file is reached or an error occurs.
-   (Normally a write at end of file would extend the inode, but
-   growth is not yet implemented.) */
+   less than SIZE if the disk is full, the maximum file size is
+   reached, the journal operation has no room left, or an error
+   occurs. */
 off_t
 inode_write_at (struct inode *inode, const void *buffer_, off_t size,
                 off_t offset) 
 {
   const uint8_t *buffer = buffer_;
+  off_t piece_max = is_metadata (inode) ? BLOCK_SECTOR_SIZE : WRITE_PIECE;
   off_t bytes_written = 0;
-  uint8_t *bounce = NULL;
 
-  if (inode->deny_write_cnt)
-    return 0;
+  while (size > 0)
+    {
+      off_t piece = piece_max - offset % piece_max;
+      off_t written;
+
+      if (piece > size)
+        piece = size;
+      written = write_piece (inode, buffer + bytes_written, piece, offset);
+
+      size -= written;
+      offset += written;
+      bytes_written += written;
+      if (written < piece)
+        break;
+    }
+  return bytes_written;
+}
+
+/* Writes SIZE bytes from BUFFER into INODE, starting at OFFSET,
+   as one journal operation.  Returns the number of bytes actually
+   written. */
+static off_t
+write_piece (struct inode *inode, const uint8_t *buffer, off_t size,
+             off_t offset) 
+{
+  off_t bytes_written = 0;
+
+  journal_begin ();
+  rwlock_acquire_write (&inode->rwlock);
+
+  /* A write that may extend INODE logs it up front, so that the
+     operation cannot run out of room for the new length after
+     writing the data. */
+  if (inode->deny_write_cnt
+      || (offset + size > inode->data.length
+          && !journal_write (inode->sector, &inode->data, 0,
+                             BLOCK_SECTOR_SIZE)))
+    {
+      rwlock_release_write (&inode->rwlock);
+      journal_end ();
+      return 0;
+    }
 
   while (size > 0) 
     {
-      /* Sector to write, starting byte offset within sector. */
-      block_sector_t sector_idx = byte_to_sector (inode, offset);
+      /* Starting byte offset within sector. */
       int sector_ofs = offset % BLOCK_SECTOR_SIZE;
+      block_sector_t sector_idx;
 
-      /* Bytes left in inode, bytes left in sector, lesser of the two. */
-      off_t inode_left = inode_length (inode) - offset;
+      /* Bytes left in the largest file, bytes left in sector,
+         lesser of the two. */
+      off_t file_left = (off_t) (MAX_SECTORS * BLOCK_SECTOR_SIZE) - offset;
       int sector_left = BLOCK_SECTOR_SIZE - sector_ofs;
-      int min_left = inode_left < sector_left ? inode_left : sector_left;
+      int min_left = file_left < sector_left ? file_left : sector_left;
 
       /* Number of bytes to actually write into this sector. */
       int chunk_size = size < min_left ? size : min_left;
       if (chunk_size <= 0)
         break;
 
-      if (sector_ofs == 0 && chunk_size == BLOCK_SECTOR_SIZE)
-        {
-          /* Write full sector directly to disk. */
-          block_write (fs_device, sector_idx, buffer + bytes_written);
-        }
-      else 
-        {
-          /* We need a bounce buffer. */
-          if (bounce == NULL) 
-            {
-              bounce = malloc (BLOCK_SECTOR_SIZE);
-              if (bounce == NULL)
-                break;
-            }
+      /* Sector to write, allocated if not written before. */
+      sector_idx = lookup_sector (inode, offset / BLOCK_SECTOR_SIZE, true);
+      if (sector_idx == 0)
+        break;
 
-          /* If the sector contains data before or after the chunk
-             we're writing, then we need to read in the sector
-             first.  Otherwise we start with a sector of all zeros. */
-          if (sector_ofs > 0 || chunk_size < sector_left) 
-            block_read (fs_device, sector_idx, bounce);
-          else
-            memset (bounce, 0, BLOCK_SECTOR_SIZE);
-          memcpy (bounce + sector_ofs, buffer + bytes_written, chunk_size);
-          block_write (fs_device, sector_idx, bounce);
-        }
+      /* The cache reads the sector first unless the chunk covers
+         all of it. */
+      if (!write_sector (sector_idx, buffer + bytes_written, sector_ofs,
+                         chunk_size, is_metadata (inode)))
+        break;
 
       /* Advance. */
       size -= chunk_size;
       offset += chunk_size;
       bytes_written += chunk_size;
     }
-  free (bounce);
 
+  /* OFFSET is now just past the last byte written.  A write
+     that wrote nothing, such as one of zero bytes past the end,
+     leaves the length alone. */
+  if (bytes_written > 0 && offset > inode->data.length)
+    {
+      inode->data.length = offset;
+      journal_write (inode->sector, &inode->data, 0, BLOCK_SECTOR_SIZE);
+    }
+  rwlock_release_write (&inode->rwlock);
+
+  /* Writing the free map file flushes it again, so INODE must be
+     unlocked first. */
+  free_map_flush ();
+  journal_end ();
   return bytes_written;
 }
 
@@ -322,8 +792,10 @@ inode_write_at (struct inode *inode, const void *buffer_, off_t size,
 void
 inode_deny_write (struct inode *inode) 
 {
+  rwlock_acquire_write (&inode->rwlock);
   inode->deny_write_cnt++;
   ASSERT (inode->deny_write_cnt <= inode->open_cnt);
+  rwlock_release_write (&inode->rwlock);
 }
 
 /* Re-enables writes to INODE.
@@ -332,9 +804,11 @@ inode_deny_write (struct inode *inode)
 void
 inode_allow_write (struct inode *inode) 
 {
+  rwlock_acquire_write (&inode->rwlock);
   ASSERT (inode->deny_write_cnt > 0);
   ASSERT (inode->deny_write_cnt <= inode->open_cnt);
   inode->deny_write_cnt--;
+  rwlock_release_write (&inode->rwlock);
 }
 
 /* Returns the length, in bytes, of INODE's data. */
@@ -343,3 +817,21 @@ inode_length (const struct inode *inode)
 {
   return inode->data.length;
 }
+
+/* Returns a hash value for the inode containing E. */
+static unsigned
+inode_hash (const struct hash_elem *e, void *aux UNUSED) 
+{
+  const struct inode *inode = hash_entry (e, struct inode, elem);
+  return hash_int (inode->sector);
+}
+
+/* Returns true if the inode containing A is in a lower sector
+   than the one containing B. */
+static bool
+inode_less (const struct hash_elem *a, const struct hash_elem *b,
+            void *aux UNUSED) 
+{
+  return (hash_entry (a, struct inode, elem)->sector
+          < hash_entry (b, struct inode, elem)->sector);
+}
@@ -0,0 +1,542 @@
+#include "filesys/journal.h"
+#include <debug.h>
+#include <list.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "devices/timer.h"
+#include "filesys/cache.h"
+#include "filesys/filesys.h"
+#include "filesys/free-map.h"
+#include "threads/malloc.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+
+/* Identifies the journal header. */
+#define JOURNAL_MAGIC 0x4a524e4c
+
+/* Most data sectors remembered by journal_order() at once. */
+#define ORDERED_MAX 64
+
+/* Timer ticks between commits of a transaction that is not full. */
+#define COMMIT_INTERVAL (TIMER_FREQ / 2)
+
+/* On-disk journal header, in sector JOURNAL_SECTOR.
+   Must be exactly BLOCK_SECTOR_SIZE bytes long.
+   If CNT is nonzero, the CNT sectors after the header hold a
+   committed transaction: new contents for SECTORS, which may not
+   have reached their home locations yet. */
+struct journal_header
+  {
+    unsigned magic;                     /* Magic number. */
+    uint32_t cnt;                       /* Number of sectors logged. */
+    block_sector_t sectors[JOURNAL_MAX]; /* Home of each logged sector. */
+    uint8_t unused[BLOCK_SECTOR_SIZE - 8 - 4 * JOURNAL_MAX]; /* Not used. */
+  };
+
+/* False if the disk has no journal, in which case metadata is
+   written like any other data. */
+static bool enabled;
+
+/* The running transaction.  Every operation between
+   journal_begin() and journal_end() belongs to it, so that many
+   small operations commit together.  Its sectors are pinned in
+   the cache until it commits. */
+static block_sector_t txn_sectors[JOURNAL_MAX];
+static size_t txn_cnt;
+
+/* File data sectors allocated by the running transaction, which
+   must reach the disk before it commits.  See journal_order(). */
+static block_sector_t ordered_sectors[ORDERED_MAX];
+static size_t ordered_cnt;
+
+/* A run of sectors freed by the running transaction.  See
+   journal_free(). */
+struct freed_run
+  {
+    struct list_elem elem;              /* Element in `freed_runs'. */
+    block_sector_t sector;              /* First sector. */
+    size_t cnt;                         /* Number of sectors. */
+  };
+static struct list freed_runs;
+
+/* Protects the members below and the running transaction. */
+static struct lock journal_lock;
+static struct condition room;        /* Signaled after each commit and
+                                        when an operation ends. */
+static size_t handle_cnt;            /* Operations in progress. */
+static size_t reserved;              /* Sectors they may still log. */
+static size_t charged;               /* Of those, sectors set aside by
+                                        journal_charge(). */
+static bool committing;              /* Commit once HANDLE_CNT is 0? */
+static bool checkpointing;           /* Last commit still being written
+                                        home? */
+
+/* Header and images of the logged sectors, used by commit() and
+   recover().  Those of a committed transaction are kept until
+   its sectors are written home. */
+static struct journal_header header;
+static uint8_t images[JOURNAL_MAX][BLOCK_SECTOR_SIZE];
+static void *image_ptrs[JOURNAL_MAX];
+
+static thread_func commit_thread NO_RETURN;
+static void recover (void);
+static bool header_is_valid (void);
+static void request_commit (void);
+static void commit (void);
+static void write_home (size_t cnt);
+static int compare_sectors (const void *, const void *);
+
+/* Initializes the journal.  If FORMAT is true, writes an empty
+   journal; otherwise, finishes any transaction that committed
+   before a crash.  Must be called before any metadata is read. */
+void
+journal_init (bool format)
+{
+  size_t i;
+
+  ASSERT (sizeof header == BLOCK_SECTOR_SIZE);
+
+  for (i = 0; i < JOURNAL_MAX; i++)
+    image_ptrs[i] = images[i];
+  list_init (&freed_runs);
+  lock_init (&journal_lock);
+  cond_init (&room);
+
+  if (format)
+    {
+      memset (&header, 0, sizeof header);
+      header.magic = JOURNAL_MAGIC;
+      block_write (fs_device, JOURNAL_SECTOR, &header);
+    }
+  else
+    {
+      block_read (fs_device, JOURNAL_SECTOR, &header);
+      if (header.magic != JOURNAL_MAGIC)
+        {
+          printf ("journal: none on disk, metadata not journaled\n");
+          return;
+        }
+      recover ();
+    }
+
+  enabled = true;
+  thread_create ("journal", PRI_DEFAULT, commit_thread, NULL);
+}
+
+/* Writes the sectors logged by the transaction in the journal, if
+   it committed, to their home locations and empties the
+   journal.  A header that could not have been written by
+   commit() is taken to be damaged: its transaction is dropped
+   rather than written over arbitrary sectors. */
+static void
+recover (void)
+{
+  if (header.cnt == 0)
+    return;
+
+  if (!header_is_valid ())
+    printf ("journal: damaged header, %"PRIu32" sectors not replayed\n",
+            header.cnt);
+  else
+    {
+      printf ("journal: replaying %"PRIu32" sectors\n", header.cnt);
+      block_read_multiple (fs_device, JOURNAL_SECTOR + 1, header.cnt,
+                           image_ptrs);
+      write_home (header.cnt);
+    }
+  header.cnt = 0;
+  block_write (fs_device, JOURNAL_SECTOR, &header);
+}
+
+/* Returns true if the journal header logs at most JOURNAL_MAX
+   sectors, each on the disk and outside the journal. */
+static bool
+header_is_valid (void)
+{
+  block_sector_t size = block_size (fs_device);
+  size_t i;
+
+  if (header.cnt > JOURNAL_MAX)
+    return false;
+  for (i = 0; i < header.cnt; i++)
+    {
+      block_sector_t sector = header.sectors[i];
+      if (sector >= size
+          || (sector >= JOURNAL_SECTOR
+              && sector < JOURNAL_SECTOR + JOURNAL_SECTORS))
+        return false;
+    }
+  return true;
+}
+
+/* Starts an operation whose metadata writes must reach the disk
+   together.  Calls may nest; the operation ends with the
+   outermost journal_end().  The outermost call must come before
+   the operation takes any file system lock, since it may wait
+   for the running transaction to commit.
+   The operation may log up to JOURNAL_OP_MAX sectors.  Room for
+   them is set aside in the running transaction, which is
+   committed first if it does not have that much room left. */
+void
+journal_begin (void)
+{
+  struct thread *t = thread_current ();
+
+  if (!enabled || t->journal_depth++ > 0)
+    return;
+
+  lock_acquire (&journal_lock);
+  while (committing || txn_cnt + reserved + JOURNAL_OP_MAX > JOURNAL_MAX)
+    {
+      if (txn_cnt + JOURNAL_OP_MAX > JOURNAL_MAX)
+        request_commit ();
+      else
+        {
+          /* The room is set aside for operations in progress.
+             Wait for one of them to end. */
+          cond_wait (&room, &journal_lock);
+        }
+    }
+  handle_cnt++;
+  reserved += JOURNAL_OP_MAX;
+  t->journal_credits = JOURNAL_OP_MAX;
+  lock_release (&journal_lock);
+}
+
+/* Ends an operation started with journal_begin().  The last
+   operation of a transaction that is due to commit commits it. */
+void
+journal_end (void)
+{
+  struct thread *t = thread_current ();
+
+  if (!enabled)
+    return;
+  ASSERT (t->journal_depth > 0);
+  if (--t->journal_depth > 0)
+    return;
+
+  lock_acquire (&journal_lock);
+  reserved -= t->journal_credits;
+  t->journal_credits = 0;
+  if (--handle_cnt == 0 && committing)
+    commit ();
+  cond_broadcast (&room, &journal_lock);
+  lock_release (&journal_lock);
+}
+
+/* Writes SIZE bytes from BUFFER starting at byte OFS of SECTOR,
+   which holds metadata, as part of the running transaction.
+   Returns true if successful.  Returns false, writing nothing, if
+   SECTOR is not logged yet and the running operation has used up
+   its credits; rewriting a sector the transaction logged already
+   always succeeds.
+   Must be called between journal_begin() and journal_end(). */
+bool
+journal_write (block_sector_t sector, const void *buffer_, int ofs,
+               int size)
+{
+  struct thread *t = thread_current ();
+  size_t i;
+
+  if (!enabled)
+    {
+      cache_write (sector, buffer_, ofs, size);
+      return true;
+    }
+  ASSERT (t->journal_depth > 0);
+
+  lock_acquire (&journal_lock);
+  for (i = 0; i < txn_cnt; i++)
+    if (txn_sectors[i] == sector)
+      break;
+  if (i == txn_cnt)
+    {
+      /* Each credit is room set aside in the transaction, so a
+         write within the operation's credits always fits. */
+      if (t->journal_credits == 0)
+        {
+          lock_release (&journal_lock);
+          return false;
+        }
+      ASSERT (txn_cnt < JOURNAL_MAX);
+      txn_sectors[txn_cnt++] = sector;
+      t->journal_credits--;
+      reserved--;
+    }
+  lock_release (&journal_lock);
+
+  /* The transaction cannot commit before the operation ends. */
+  cache_write_pinned (sector, buffer_, ofs, size);
+  return true;
+}
+
+/* Sets aside one of the running operation's credits for a sector
+   of the free map that the operation changed, so that
+   free_map_flush() can log it later, possibly in another
+   operation of the same transaction.  If the operation has no
+   credits left, takes one from the transaction's free room.
+   Returns false if there is none either.  Outside an operation,
+   does nothing and returns true. */
+bool
+journal_charge (void)
+{
+  struct thread *t = thread_current ();
+  bool success = true;
+
+  if (!enabled || t->journal_depth == 0)
+    return true;
+
+  lock_acquire (&journal_lock);
+  if (t->journal_credits > 0)
+    t->journal_credits--;
+  else if (txn_cnt + reserved < JOURNAL_MAX)
+    reserved++;
+  else
+    success = false;
+  if (success)
+    charged++;
+  lock_release (&journal_lock);
+  return success;
+}
+
+/* Gives the running operation up to CNT of the credits set aside
+   by journal_charge(), to log the free map sectors they were set
+   aside for.  Does nothing outside an operation. */
+void
+journal_claim (size_t cnt)
+{
+  struct thread *t = thread_current ();
+
+  if (!enabled || t->journal_depth == 0)
+    return;
+
+  lock_acquire (&journal_lock);
+  if (cnt > charged)
+    cnt = charged;
+  charged -= cnt;
+  t->journal_credits += cnt;
+  lock_release (&journal_lock);
+}
+
+/* Notes that SECTOR, which holds file data, was just allocated
+   by the running operation.  Data is not journaled, but the
+   sector is written to disk before the transaction that points
+   a file at it commits, so that after a crash a file never shows
+   what the sector held before it was allocated.
+   When ORDERED_MAX sectors are waiting, they are written at once.
+   Some of them may be written again after that, before the
+   transaction commits; then a crash may leave them holding zeros
+   or older data of the same file, but still not another file's.
+   Must be called between journal_begin() and journal_end(). */
+void
+journal_order (block_sector_t sector)
+{
+  if (!enabled)
+    return;
+  ASSERT (thread_current ()->journal_depth > 0);
+
+  lock_acquire (&journal_lock);
+  if (ordered_cnt == ORDERED_MAX)
+    {
+      cache_write_sectors (ordered_sectors, ordered_cnt);
+      ordered_cnt = 0;
+    }
+  ordered_sectors[ordered_cnt++] = sector;
+  lock_release (&journal_lock);
+}
+
+/* Holds back the CNT sectors starting at SECTOR, just freed by
+   the running operation, from reuse until the transaction
+   commits; free_map_reuse() is called for them then.  Otherwise
+   another file could write them before the metadata that stops
+   pointing to them reaches the disk, and a crash would leave that
+   metadata pointing to the other file's data.
+   Returns false if there is no running operation, in which case
+   the caller may reuse the sectors at once.  If memory is short,
+   the sectors are not reused until the free map is next read. */
+bool
+journal_free (block_sector_t sector, size_t cnt)
+{
+  struct freed_run *run;
+
+  if (!enabled || thread_current ()->journal_depth == 0)
+    return false;
+
+  run = malloc (sizeof *run);
+  if (run != NULL)
+    {
+      run->sector = sector;
+      run->cnt = cnt;
+      lock_acquire (&journal_lock);
+      list_push_back (&freed_runs, &run->elem);
+      lock_release (&journal_lock);
+    }
+  return true;
+}
+
+/* Commits the running transaction and waits for the commit to
+   finish, including writing its sectors home.  Must not be called
+   between journal_begin() and journal_end(). */
+void
+journal_flush (void)
+{
+  if (!enabled)
+    return;
+  ASSERT (thread_current ()->journal_depth == 0);
+
+  lock_acquire (&journal_lock);
+  request_commit ();
+  while (checkpointing)
+    cond_wait (&room, &journal_lock);
+  lock_release (&journal_lock);
+}
+
+/* Commits the running transaction every COMMIT_INTERVAL ticks,
+   so that operations reach the disk even when the transaction
+   does not fill up. */
+static void
+commit_thread (void *aux UNUSED)
+{
+  for (;;)
+    {
+      timer_sleep (COMMIT_INTERVAL);
+      journal_flush ();
+    }
+}
+
+/* Asks for the running transaction to commit once its operations
+   end, and waits until it has.  Does nothing if the transaction
+   is empty.  Must be called with journal_lock held. */
+static void
+request_commit (void)
+{
+  if (!committing)
+    {
+      if (txn_cnt == 0)
+        return;
+      committing = true;
+      if (handle_cnt == 0)
+        {
+          commit ();
+          return;
+        }
+    }
+  while (committing)
+    cond_wait (&room, &journal_lock);
+}
+
+/* Commits the running transaction, which has no operations in
+   progress: writes the file data sectors it allocated, logs its
+   sectors, and writes the header that makes the log count.  A
+   crash before the header write loses the whole transaction; one
+   after it is repaired by recover().  Then starts a new
+   transaction and wakes up anyone waiting, and, while the new
+   transaction's operations run, writes the logged sectors home,
+   empties the journal, and lets the sectors the transaction freed
+   be reused.
+   Must be called with journal_lock held, which is released while
+   the disk is written. */
+static void
+commit (void)
+{
+  struct list freed;
+  size_t cnt;
+  size_t i;
+
+  ASSERT (committing && handle_cnt == 0);
+
+  /* The journal and the images still hold the last transaction
+     until it is home. */
+  while (checkpointing)
+    cond_wait (&room, &journal_lock);
+
+  list_init (&freed);
+  while (!list_empty (&freed_runs))
+    list_push_back (&freed, list_pop_front (&freed_runs));
+
+  /* Sort the sectors, so that they are written home in one sweep
+     of the disk.  The images are copied from the cache now, since
+     the next transaction may change the sectors again before they
+     are home. */
+  cnt = txn_cnt;
+  qsort (txn_sectors, cnt, sizeof *txn_sectors, compare_sectors);
+  for (i = 0; i < cnt; i++)
+    cache_read (txn_sectors[i], images[i], 0, BLOCK_SECTOR_SIZE);
+  header.cnt = cnt;
+  memcpy (header.sectors, txn_sectors, cnt * sizeof *txn_sectors);
+
+  /* While COMMITTING is set, no operation can start, so the
+     transaction does not change with the lock released. */
+  lock_release (&journal_lock);
+  cache_write_sectors (ordered_sectors, ordered_cnt);
+  if (cnt > 0)
+    {
+      block_write_multiple (fs_device, JOURNAL_SECTOR + 1, cnt,
+                            (const void *const *) image_ptrs);
+      block_write (fs_device, JOURNAL_SECTOR, &header);
+    }
+  lock_acquire (&journal_lock);
+
+  /* The sectors may now reach home through the cache as well. */
+  for (i = 0; i < cnt; i++)
+    cache_unpin (txn_sectors[i], false);
+  ordered_cnt = 0;
+  txn_cnt = 0;
+  committing = false;
+  checkpointing = true;
+  cond_broadcast (&room, &journal_lock);
+  lock_release (&journal_lock);
+
+  /* The images hold exactly what committed, even where the cache
+     holds newer changes.  The freed sectors are only reused once
+     nothing can replay the transaction over them.  The free map
+     is locked before the journal elsewhere, so it is not locked
+     with journal_lock held. */
+  if (cnt > 0)
+    {
+      write_home (cnt);
+      header.cnt = 0;
+      block_write (fs_device, JOURNAL_SECTOR, &header);
+    }
+  while (!list_empty (&freed))
+    {
+      struct freed_run *run = list_entry (list_pop_front (&freed),
+                                          struct freed_run, elem);
+      free_map_reuse (run->sector, run->cnt);
+      free (run);
+    }
+
+  lock_acquire (&journal_lock);
+  checkpointing = false;
+  cond_broadcast (&room, &journal_lock);
+}
+
+/* Writes the first CNT images to the sectors that the journal
+   header logs them for, which are sorted, writing each run of
+   consecutive sectors with one request. */
+static void
+write_home (size_t cnt)
+{
+  size_t i, j;
+
+  for (i = 0; i < cnt; i = j)
+    {
+      for (j = i + 1;
+           j < cnt && header.sectors[j] == header.sectors[j - 1] + 1; j++)
+        continue;
+      block_write_multiple (fs_device, header.sectors[i], j - i,
+                            (const void *const *) (image_ptrs + i));
+    }
+}
+
+/* Orders sector numbers, for qsort(). */
+static int
+compare_sectors (const void *a_, const void *b_)
+{
+  block_sector_t a = *(const block_sector_t *) a_;
+  block_sector_t b = *(const block_sector_t *) b_;
+
+  return a < b ? -1 : a > b;
+}
@@ -0,0 +1,35 @@
+#ifndef FILESYS_JOURNAL_H
+#define FILESYS_JOURNAL_H
+
+#include <stdbool.h>
+#include "devices/block.h"
+
+/* Most sectors one transaction can log.  Each stays pinned in the
+   64-entry buffer cache until the transaction commits, which
+   bounds this.  With JOURNAL_OP_MAX, at most two operations can be
+   in progress in a transaction at once; an operation gives back
+   the room it did not use when it ends, so many small operations
+   still commit together. */
+#define JOURNAL_MAX 32
+
+/* Most sectors one operation may log.  journal_begin() keeps this
+   much room for each operation and journal_write() refuses to log
+   more, so operations that could log more are split into several
+   or fail part way through. */
+#define JOURNAL_OP_MAX 16
+
+/* Sectors the journal occupies, starting at JOURNAL_SECTOR: a
+   header followed by one sector per logged sector. */
+#define JOURNAL_SECTORS (1 + JOURNAL_MAX)
+
+void journal_init (bool format);
+void journal_begin (void);
+void journal_end (void);
+bool journal_write (block_sector_t, const void *, int ofs, int size);
+bool journal_charge (void);
+void journal_claim (size_t cnt);
+bool journal_free (block_sector_t, size_t cnt);
+void journal_order (block_sector_t);
+void journal_flush (void);
+
+#endif /* filesys/journal.h */
@@ -351,6 +351,27 @@ bitmap_read (struct bitmap *b, struct file *file)
   return success;
 }
 
+/* Reads the SIZE bytes starting at byte OFS of what
+   bitmap_read() would read into B from the same place in FILE,
+   stopping at the end of B.  Returns true if successful, false
+   otherwise. */
+bool
+bitmap_read_part (struct bitmap *b, struct file *file,
+                  size_t ofs, size_t size)
+{
+  size_t file_size = byte_cnt (b->bit_cnt);
+  bool success;
+  if (ofs >= file_size)
+    return true;
+  if (size > file_size - ofs)
+    size = file_size - ofs;
+  success = (size_t) file_read_at (file, (uint8_t *) b->bits + ofs,
+                                   size, ofs) == size;
+  if (ofs + size == file_size)
+    b->bits[elem_cnt (b->bit_cnt) - 1] &= last_mask (b);
+  return success;
+}
+
 /* Writes B to FILE.  Return true if successful, false
    otherwise. */
 bool
@@ -359,6 +380,23 @@ bitmap_write (const struct bitmap *b, struct file *file)
   off_t size = byte_cnt (b->bit_cnt);
   return file_write_at (file, b->bits, size, 0) == size;
 }
+
+/* Writes the SIZE bytes starting at byte OFS of what
+   bitmap_write() would write for B to the same place in FILE,
+   stopping at the end of B.  Return true if successful, false
+   otherwise. */
+bool
+bitmap_write_part (const struct bitmap *b, struct file *file,
+                   size_t ofs, size_t size)
+{
+  size_t file_size = byte_cnt (b->bit_cnt);
+  if (ofs >= file_size)
+    return true;
+  if (size > file_size - ofs)
+    size = file_size - ofs;
+  return (size_t) file_write_at (file, (const uint8_t *) b->bits + ofs,
+                                 size, ofs) == size;
+}
 #endif /* FILESYS */
 
 /* Debugging. */
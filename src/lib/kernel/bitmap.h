@@ -42,7 +42,11 @@ size_t bitmap_scan_and_flip (struct bitmap *, size_t start, size_t cnt, bool);
 struct file;
 size_t bitmap_file_size (const struct bitmap *);
 bool bitmap_read (struct bitmap *, struct file *);
+bool bitmap_read_part (struct bitmap *, struct file *,
+                       size_t ofs, size_t size);
 bool bitmap_write (const struct bitmap *, struct file *);
+bool bitmap_write_part (const struct bitmap *, struct file *,
+                        size_t ofs, size_t size);
 #endif
 
 /* Debugging. */
@@ -0,0 +1,22 @@
+#ifndef __LIB_PAGESTATS_H
+#define __LIB_PAGESTATS_H
+
+#include <stdint.h>
+
+/* Paging activity of one process, or of the whole system, as
+   reported by the pagestats system call.  Evictions and the I/O
+   they cause are charged to the process whose fault or system
+   call needed the frame, not to the owner of the evicted page. */
+struct pagestats
+  {
+    uint64_t minor_faults;      /* Faults served without I/O. */
+    uint64_t major_faults;      /* Faults that read a file or swap. */
+    uint64_t fault_ticks;       /* Timer ticks spent serving faults. */
+    uint64_t file_reads;        /* Pages read from files. */
+    uint64_t swap_ins;          /* Pages read from swap. */
+    uint64_t swap_outs;         /* Pages written to swap. */
+    uint64_t writebacks;        /* Mapped pages written to their file. */
+    uint64_t evictions;         /* Frames taken from their pages. */
+  };
+
+#endif /* lib/pagestats.h */
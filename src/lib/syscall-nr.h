@@ -29,6 +29,10 @@ enum
     SYS_READDIR,                /* Reads a directory entry. */
     SYS_ISDIR,                  /* Tests if a fd represents a directory. */
     SYS_INUMBER,                /* Returns the inode number for a fd. */
+
+    /* Extensions. */
+    SYS_FORK,                   /* Clone the current process. */
+    SYS_PAGESTATS,              /* Report paging statistics. */
     
     END_SYS_CALL,
   };
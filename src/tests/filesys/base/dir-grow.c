@@ -0,0 +1,84 @@
+/* Creates enough files in one directory to make it grow several
+   times, then checks that every file can be found, that readdir
+   lists each of them once, and that removing half of them leaves
+   the other half in place. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define FILE_CNT 200
+
+void
+test_main (void) 
+{
+  static bool seen[FILE_CNT];
+  char name[READDIR_MAX_LEN + 1];
+  char file_name[32];
+  int found;
+  int fd;
+  int i;
+
+  CHECK (mkdir ("d"), "mkdir \"d\"");
+
+  msg ("creating d/f0...d/f%d", FILE_CNT - 1);
+  quiet = true;
+  for (i = 0; i < FILE_CNT; i++)
+    {
+      snprintf (file_name, sizeof file_name, "d/f%d", i);
+      CHECK (create (file_name, 0), "create \"%s\"", file_name);
+    }
+  quiet = false;
+
+  msg ("opening d/f0...d/f%d", FILE_CNT - 1);
+  quiet = true;
+  for (i = 0; i < FILE_CNT; i++)
+    {
+      snprintf (file_name, sizeof file_name, "d/f%d", i);
+      CHECK ((fd = open (file_name)) > 1, "open \"%s\"", file_name);
+      close (fd);
+    }
+  quiet = false;
+
+  CHECK ((fd = open ("d")) > 1, "open \"d\"");
+  found = 0;
+  while (readdir (fd, name))
+    {
+      if (name[0] != 'f' || (i = atoi (name + 1)) < 0 || i >= FILE_CNT)
+        fail ("readdir \"d\" returned unexpected \"%s\"", name);
+      if (seen[i])
+        fail ("readdir \"d\" returned \"%s\" twice", name);
+      seen[i] = true;
+      found++;
+    }
+  close (fd);
+  CHECK (found == FILE_CNT, "readdir \"d\" found %d files", FILE_CNT);
+
+  msg ("removing the odd-numbered files");
+  quiet = true;
+  for (i = 1; i < FILE_CNT; i += 2)
+    {
+      snprintf (file_name, sizeof file_name, "d/f%d", i);
+      CHECK (remove (file_name), "remove \"%s\"", file_name);
+    }
+  quiet = false;
+
+  msg ("checking the remaining files");
+  quiet = true;
+  for (i = 0; i < FILE_CNT; i++)
+    {
+      snprintf (file_name, sizeof file_name, "d/f%d", i);
+      fd = open (file_name);
+      if (i % 2 == 0)
+        {
+          CHECK (fd > 1, "open \"%s\"", file_name);
+          close (fd);
+        }
+      else
+        CHECK (fd == -1, "open removed \"%s\"", file_name);
+    }
+  quiet = false;
+}
@@ -0,0 +1,16 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(dir-grow) begin
+(dir-grow) mkdir "d"
+(dir-grow) creating d/f0...d/f199
+(dir-grow) opening d/f0...d/f199
+(dir-grow) open "d"
+(dir-grow) readdir "d" found 200 files
+(dir-grow) removing the odd-numbered files
+(dir-grow) checking the remaining files
+(dir-grow) end
+EOF
+pass;
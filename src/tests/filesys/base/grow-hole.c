@@ -0,0 +1,37 @@
+/* Writes past the end of an empty file, leaving a hole, and
+   checks that the hole reads back as zeros.  A write of zero
+   bytes past the end must not extend the file. */
+
+#include <random.h>
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define HOLE_SIZE 70000
+
+static char buf[HOLE_SIZE + 1234];
+
+void
+test_main (void) 
+{
+  const char *file_name = "hole";
+  int fd;
+
+  CHECK (create (file_name, 0), "create \"%s\"", file_name);
+  CHECK ((fd = open (file_name)) > 1, "open \"%s\"", file_name);
+
+  msg ("seek \"%s\" to %d", file_name, HOLE_SIZE);
+  seek (fd, HOLE_SIZE);
+  CHECK (write (fd, buf, 0) == 0, "write 0 bytes to \"%s\"", file_name);
+  CHECK (filesize (fd) == 0, "filesize \"%s\" is still 0", file_name);
+
+  random_bytes (buf + HOLE_SIZE, sizeof buf - HOLE_SIZE);
+  CHECK (write (fd, buf + HOLE_SIZE, sizeof buf - HOLE_SIZE)
+         == (int) (sizeof buf - HOLE_SIZE),
+         "write \"%s\" past end of file", file_name);
+  msg ("close \"%s\"", file_name);
+  close (fd);
+
+  check_file (file_name, buf, sizeof buf);
+}
@@ -0,0 +1,19 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(grow-hole) begin
+(grow-hole) create "hole"
+(grow-hole) open "hole"
+(grow-hole) seek "hole" to 70000
+(grow-hole) write 0 bytes to "hole"
+(grow-hole) filesize "hole" is still 0
+(grow-hole) write "hole" past end of file
+(grow-hole) close "hole"
+(grow-hole) open "hole" for verification
+(grow-hole) verified contents of "hole"
+(grow-hole) close "hole"
+(grow-hole) end
+EOF
+pass;
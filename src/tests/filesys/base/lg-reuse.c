@@ -0,0 +1,61 @@
+/* Writes a file of half the disk, removes it, and does it again
+   several times.  Each write and each removal takes many journal
+   operations; if any of the removed file's sectors were not freed,
+   a later round would run out of space. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define FILE_SIZE (1024 * 1024)
+#define BLOCK_SIZE 4096
+#define ROUND_CNT 4
+
+static char block[BLOCK_SIZE];
+static char read_block[BLOCK_SIZE];
+
+/* Fills BLOCK with the contents of block IDX of the file written
+   in round ROUND. */
+static void
+fill_block (int round, int idx)
+{
+  memset (block, 'a' + (round * 7 + idx) % 26, sizeof block);
+}
+
+void
+test_main (void) 
+{
+  const char *file_name = "big";
+  int round;
+
+  for (round = 0; round < ROUND_CNT; round++)
+    {
+      int fd;
+      int i;
+
+      CHECK (create (file_name, 0), "create \"%s\"", file_name);
+      CHECK ((fd = open (file_name)) > 1, "open \"%s\"", file_name);
+      msg ("write %d bytes to \"%s\"", FILE_SIZE, file_name);
+      for (i = 0; i < FILE_SIZE / BLOCK_SIZE; i++)
+        {
+          fill_block (round, i);
+          if (write (fd, block, BLOCK_SIZE) != BLOCK_SIZE)
+            fail ("write of block %d of \"%s\" failed", i, file_name);
+        }
+
+      msg ("read back \"%s\"", file_name);
+      seek (fd, 0);
+      for (i = 0; i < FILE_SIZE / BLOCK_SIZE; i++)
+        {
+          fill_block (round, i);
+          if (read (fd, read_block, BLOCK_SIZE) != BLOCK_SIZE)
+            fail ("read of block %d of \"%s\" failed", i, file_name);
+          compare_bytes (read_block, block, BLOCK_SIZE, i * BLOCK_SIZE,
+                         file_name);
+        }
+      msg ("close \"%s\"", file_name);
+      close (fd);
+      CHECK (remove (file_name), "remove \"%s\"", file_name);
+    }
+}
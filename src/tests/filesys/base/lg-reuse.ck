@@ -0,0 +1,33 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(lg-reuse) begin
+(lg-reuse) create "big"
+(lg-reuse) open "big"
+(lg-reuse) write 1048576 bytes to "big"
+(lg-reuse) read back "big"
+(lg-reuse) close "big"
+(lg-reuse) remove "big"
+(lg-reuse) create "big"
+(lg-reuse) open "big"
+(lg-reuse) write 1048576 bytes to "big"
+(lg-reuse) read back "big"
+(lg-reuse) close "big"
+(lg-reuse) remove "big"
+(lg-reuse) create "big"
+(lg-reuse) open "big"
+(lg-reuse) write 1048576 bytes to "big"
+(lg-reuse) read back "big"
+(lg-reuse) close "big"
+(lg-reuse) remove "big"
+(lg-reuse) create "big"
+(lg-reuse) open "big"
+(lg-reuse) write 1048576 bytes to "big"
+(lg-reuse) read back "big"
+(lg-reuse) close "big"
+(lg-reuse) remove "big"
+(lg-reuse) end
+EOF
+pass;
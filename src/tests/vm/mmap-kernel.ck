@@ -0,0 +1,11 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(mmap-kernel) begin
+(mmap-kernel) open "sample.txt"
+(mmap-kernel) try to mmap in kernel space
+(mmap-kernel) end
+EOF
+pass;
@@ -0,0 +1,21 @@
+/* Verifies that a memory mapping in the last page of the address
+   space, whose end would wrap around past 4 GB, is disallowed.
+
+   A mapping that starts below PHYS_BASE and runs past it always
+   covers the initial stack page, so it is refused as overlapping
+   whether or not its end is checked; this test reaches the range
+   check instead. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+void
+test_main (void) 
+{
+  int handle;
+  
+  CHECK ((handle = open ("zeros")) > 1, "open \"zeros\"");
+  CHECK (mmap (handle, (void *) 0xfffff000) == MAP_FAILED,
+         "try to mmap across the end of the address space");
+}
@@ -0,0 +1,11 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(mmap-wrap) begin
+(mmap-wrap) open "zeros"
+(mmap-wrap) try to mmap across the end of the address space
+(mmap-wrap) end
+EOF
+pass;
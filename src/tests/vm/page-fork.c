@@ -0,0 +1,41 @@
+/* Forks a child that rewrites a data buffer it shares
+   copy-on-write with its parent, and checks that each process
+   sees only its own writes. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define SIZE (64 * 1024)
+
+static char buf[SIZE];
+
+void
+test_main (void)
+{
+  size_t i;
+  pid_t child;
+
+  for (i = 0; i < sizeof buf; i++)
+    buf[i] = i % 251;
+
+  child = fork ();
+  if (child == 0)
+    {
+      for (i = 0; i < sizeof buf; i++)
+        buf[i] = ~buf[i];
+      for (i = 0; i < sizeof buf; i++)
+        if (buf[i] != (char) ~(i % 251))
+          fail ("child: byte %zu is wrong", i);
+      msg ("child: buffer rewritten");
+      exit (81);
+    }
+  if (child == PID_ERROR)
+    fail ("fork failed");
+
+  CHECK (wait (child) == 81, "wait for child");
+  for (i = 0; i < sizeof buf; i++)
+    if (buf[i] != (char) (i % 251))
+      fail ("parent: byte %zu changed", i);
+  msg ("parent: buffer unchanged");
+}
@@ -0,0 +1,12 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(page-fork) begin
+(page-fork) child: buffer rewritten
+(page-fork) wait for child
+(page-fork) parent: buffer unchanged
+(page-fork) end
+EOF
+pass;
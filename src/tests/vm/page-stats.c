@@ -0,0 +1,63 @@
+/* Touches every page of a 2 MB buffer, more than fits in the
+   user pool, then reads each page back, and checks that the
+   pagestats system call counted the faults, evictions and swap
+   traffic this caused. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define SIZE (2 * 1024 * 1024)
+#define PAGE_SIZE 4096
+
+static char buf[SIZE];
+
+void
+test_main (void)
+{
+  struct pagestats before, after, system;
+  size_t i;
+
+  pagestats (&before, false);
+
+  msg ("write one byte to each page");
+  for (i = 0; i < SIZE; i += PAGE_SIZE)
+    buf[i] = i / PAGE_SIZE;
+
+  msg ("read each page back");
+  for (i = 0; i < SIZE; i += PAGE_SIZE)
+    if (buf[i] != (char) (i / PAGE_SIZE))
+      fail ("byte %zu is wrong", i);
+
+  pagestats (&after, false);
+  pagestats (&system, true);
+
+  msg ("check process counters");
+  if (after.minor_faults - before.minor_faults < SIZE / PAGE_SIZE / 2)
+    fail ("too few minor faults");
+  if (after.evictions == before.evictions)
+    fail ("no evictions");
+  if (after.swap_outs == before.swap_outs)
+    fail ("no swap outs");
+  if (after.swap_ins == before.swap_ins)
+    fail ("no swap ins");
+  if (after.major_faults == before.major_faults)
+    fail ("no major faults");
+  if (after.swap_outs > after.evictions)
+    fail ("more swap outs than evictions");
+  if (after.swap_ins > after.swap_outs)
+    fail ("more swap ins than swap outs");
+  if (after.major_faults > after.file_reads + after.swap_ins)
+    fail ("more major faults than pages read");
+
+  msg ("check system counters");
+  if (system.minor_faults < after.minor_faults
+      || system.major_faults < after.major_faults
+      || system.fault_ticks < after.fault_ticks
+      || system.file_reads < after.file_reads
+      || system.swap_ins < after.swap_ins
+      || system.swap_outs < after.swap_outs
+      || system.writebacks < after.writebacks
+      || system.evictions < after.evictions)
+    fail ("system counter below process counter");
+}
@@ -0,0 +1,13 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(page-stats) begin
+(page-stats) write one byte to each page
+(page-stats) read each page back
+(page-stats) check process counters
+(page-stats) check system counters
+(page-stats) end
+EOF
+pass;
@@ -0,0 +1,34 @@
+/* Pushes onto the lowest page the stack may grow to, which must
+   succeed, and then onto the page below it.  The process must be
+   terminated with -1 exit code.  The stack may grow to 8 MB by
+   default. */
+
+#include "tests/lib.h"
+#include "tests/main.h"
+
+/* Lowest address the stack may grow to: PHYS_BASE less the
+   kernel's default stack limit, STACK_PAGE_LIMIT in vm/page.h,
+   which must be kept in step. */
+#define STACK_LIMIT (8 * 1024 * 1024)
+#define STACK_BOTTOM (0xc0000000 - STACK_LIMIT)
+
+/* Pushes a word with the stack pointer set to ESP, then restores
+   the stack pointer. */
+static void
+push_at (unsigned esp)
+{
+  asm volatile ("movl %%esp, %%ebx\n\t"
+                "movl %0, %%esp\n\t"
+                "pushl $0\n\t"
+                "movl %%ebx, %%esp"
+                : : "r" (esp) : "ebx", "memory");
+}
+
+void
+test_main (void)
+{
+  push_at (STACK_BOTTOM + 4);
+  msg ("pushed onto the lowest stack page");
+  push_at (STACK_BOTTOM);
+  fail ("pushed below the stack limit");
+}
@@ -0,0 +1,10 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_USER_FAULTS => 1, [<<'EOF']);
+(pt-grow-limit) begin
+(pt-grow-limit) pushed onto the lowest stack page
+pt-grow-limit: exit(-1)
+EOF
+pass;
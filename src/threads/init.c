@@ -37,6 +37,11 @@
 #include "filesys/filesys.h"
 #include "filesys/fsutil.h"
 #endif
+#ifdef VM
+#include "vm/frame.h"
+#include "vm/page.h"
+#include "vm/swap.h"
+#endif
 
 /* Page directory with kernel mappings only. */
 uint32_t *init_page_dir;
@@ -98,6 +103,10 @@ main (void)
   palloc_init (user_page_limit);
   malloc_init ();
   paging_init ();
+#ifdef VM
+  frame_init ();
+  page_init ();
+#endif
 
   /* Segmentation. */
 #ifdef USERPROG
@@ -126,6 +135,9 @@ main (void)
   locate_block_devices ();
   filesys_init (format_filesys);
 #endif
+#ifdef VM
+  swap_init ();
+#endif
 
   printf ("Boot complete.\n");
   
@@ -259,6 +271,16 @@ parse_options (char **argv)
 #ifdef USERPROG
       else if (!strcmp (name, "-ul"))
         user_page_limit = atoi (value);
+#endif
+#ifdef VM
+      else if (!strcmp (name, "-stk"))
+        {
+          int pages = atoi (value);
+          if (pages < 1 || (size_t) pages > STACK_PAGE_LIMIT_MAX)
+            PANIC ("-stk must be between 1 and %zu pages",
+                   (size_t) STACK_PAGE_LIMIT_MAX);
+          stack_page_limit = pages;
+        }
 #endif
       else
         PANIC ("unknown option `%s' (use -h for help)", name);
@@ -381,6 +403,9 @@ usage (void)
           "  -mlfqs             Use multi-level feedback queue scheduler.\n"
 #ifdef USERPROG
           "  -ul=COUNT          Limit user memory to COUNT pages.\n"
+#endif
+#ifdef VM
+          "  -stk=COUNT         Limit user stacks to COUNT pages.\n"
 #endif
           );
   shutdown_power_off ();
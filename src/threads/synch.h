@@ -45,6 +45,25 @@ void cond_wait (struct condition *, struct lock *);
 void cond_signal (struct condition *, struct lock *);
 void cond_broadcast (struct condition *, struct lock *);
 
+/* Readers-writer lock.
+   Any number of readers, or a single writer, may hold it.  New
+   readers wait while a writer is waiting, so that writers are
+   not starved. */
+struct rwlock
+{
+  struct lock lock;           /* Protects the members below. */
+  struct condition changed;   /* Signaled when the lock is released. */
+  unsigned readers;           /* Number of readers holding the lock. */
+  unsigned waiting_writers;   /* Number of writers waiting for it. */
+  struct thread *writer;      /* Writer holding the lock, or NULL. */
+};
+
+void rwlock_init (struct rwlock *);
+void rwlock_acquire_read (struct rwlock *);
+void rwlock_release_read (struct rwlock *);
+void rwlock_acquire_write (struct rwlock *);
+void rwlock_release_write (struct rwlock *);
+
 /* Optimization barrier.
 
    The compiler will not reorder operations across an
@@ -672,6 +672,17 @@ init_thread (struct thread *t, const char *name, int priority)
   list_init (&t->file_descriptors);
   t->state = NOT_INITIALIZE;
   // #endif
+#ifdef USERPROG
+  t->cwd = NULL;
+#endif
+#ifdef FILESYS
+  t->journal_depth = 0;
+  t->journal_credits = 0;
+#endif
+#ifdef VM
+  t->mapid_incrementor = 0;
+  list_init (&t->mappings);
+#endif
 
   old_level = intr_disable ();
   list_push_back (&all_list, &t->allelem);
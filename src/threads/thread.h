@@ -5,6 +5,7 @@
 #include <debug.h>
 #include <list.h>
 #include <hash.h>
+#include <pagestats.h>
 #include <stdint.h>
 
 /* States in a thread's life cycle. */
@@ -111,9 +112,29 @@ struct thread
   int fd_incrementor;
   struct list file_descriptors;
   struct file * exec_file;
+  struct dir *cwd; /* Working directory, or NULL for the root. */
 
 #endif
 
+#ifdef FILESYS
+  /* Owned by filesys/journal.c. */
+  int journal_depth; /* Nesting of journal_begin() calls. */
+  int journal_credits; /* Sectors the operation may still log. */
+#endif
+
+#ifdef VM
+  /* Owned by vm/page.c. */
+  struct hash pages; /* Supplemental page table. */
+  struct intr_frame *user_if; /* User registers on entry to a system call. */
+  void *fault_next;    /* Page a sequential scan would fault on next. */
+  size_t fault_window; /* Pages to bring in ahead of such a fault. */
+  struct pagestats pagestats; /* Paging activity of the process. */
+
+  /* Owned by vm/mmap.c. */
+  int mapid_incrementor;
+  struct list mappings; /* Memory mapped files. */
+#endif
+
   /* Owned by thread.c. */
   unsigned magic; /* Detects stack overflow. */
 };
@@ -5,7 +5,11 @@
 #include "userprog/syscall.h"
 #include "threads/interrupt.h"
 #include "threads/thread.h"
+#include "threads/vaddr.h"
 #include "userprog/process.h"
+#ifdef VM
+#include "vm/page.h"
+#endif
 
 /* Number of page faults processed. */
 static long long page_fault_cnt;
@@ -150,9 +154,24 @@ page_fault (struct intr_frame *f)
   write = (f->error_code & PF_W) != 0;
   user = (f->error_code & PF_U) != 0;
 
-  /* To implement virtual memory, delete the rest of the function
-     body, and replace it with code that brings in the page to
-     which fault_addr refers. */
+#ifdef VM
+  /* Bring in the page if it is a lazily loaded part of the
+     process's address space, grow the stack if the access is just
+     below the stack pointer, or copy a page shared copy-on-write.
+     Faults in kernel context land here too, when a system call
+     touches a user buffer; the user stack pointer was saved on
+     entry to the system call.  A kernel fault outside a system
+     call, with no saved stack pointer, may only bring in pages
+     that already exist. */
+  if (is_user_vaddr (fault_addr))
+    {
+      struct intr_frame *user_if = thread_current ()->user_if;
+      void *esp = user ? f->esp : user_if != NULL ? user_if->esp : NULL;
+      if (page_handle_fault (fault_addr, not_present, write, esp))
+        return;
+    }
+#endif
+
   printf ("Page fault at %p: %s error %s page in %s context.\n",
           fault_addr,
           not_present ? "not present" : "rights violation",
@@ -12,6 +12,10 @@
 #include "userprog/pagedir.h"
 #include "userprog/syscall.h"
 #include "userprog/tss.h"
+#ifdef VM
+#include "vm/mmap.h"
+#include "vm/page.h"
+#endif
 #include <debug.h>
 #include <inttypes.h>
 #include <list.h>
@@ -59,8 +63,27 @@ static struct start_process_args
   void *temp_for_build_stack;             // temp page to store the command line   
   int argc;                               // number of args
   size_t len_argv;                        // length of command line 
+  struct dir *cwd;                        // working directory, owned by
+                                          // the child once it starts
 };
 
+#ifdef VM
+/* Passed by a process to the child it forks. */
+struct fork_args
+{
+  struct semaphore child_setup_sema; // Used by parent process to wait for
+                                     // child to finish copying it
+  bool child_start_success;          // To indicate whether child process has
+                                     // copied the parent successfully
+  struct process_child_state *state; // initialized in child process
+  struct thread *parent;             // process being forked
+  struct intr_frame if_;             // user registers at the fork() call
+};
+
+static thread_func start_fork NO_RETURN;
+static bool fork_files (struct thread *parent);
+#endif
+
 static thread_func start_process NO_RETURN;
 static bool load (void *process_args, void (**eip) (void), void **esp);
 static struct process_child_state *pids_find_and_remove (struct list *l,
@@ -100,6 +123,7 @@ init_start_process_args (void)
 
   sema_init (&start_process_args->child_setup_sema, 0);
   start_process_args->child_start_success = false;
+  start_process_args->cwd = NULL;
 
   return start_process_args;
 }
@@ -184,12 +208,25 @@ process_execute (const char *file_name)
   process_args->len_argv = len_argv;
   process_args->argc = argc;
 
+  // the child starts in the same working directory
+  struct dir *cwd = thread_current ()->cwd;
+  if (cwd != NULL)
+    {
+      process_args->cwd = dir_reopen (cwd);
+      if (process_args->cwd == NULL)
+        {
+          free_start_process_args (process_args);
+          return TID_ERROR;
+        }
+    }
+
   tid = thread_create (process_args->thread_name, PRI_DEFAULT, start_process,
                        process_args);
   // child process is not created at all
   // there is no thread call sema_up, thus return earlier
   if (tid == TID_ERROR)
     {
+      dir_close (process_args->cwd);
       free_start_process_args (process_args);
       return TID_ERROR;
     }
@@ -223,9 +260,10 @@ start_process (void *aux)
   if_.cs = SEL_UCSEG;
   if_.eflags = FLAG_IF | FLAG_MBS;
 
-  lock_acquire (&filesys_lock);
+  // the executable is looked up in the working directory
+  thread_current ()->cwd = start_process_args->cwd;
+
   bool success = load (start_process_args, &if_.eip, &if_.esp);
-  lock_release (&filesys_lock);
 
   if (!success)
     {
@@ -266,6 +304,156 @@ start_process (void *aux)
   NOT_REACHED ();
 }
 
+#ifdef VM
+/* Starts a new process that is a copy of the current one.  The
+   child resumes from the system call whose user registers are
+   IF_, with 0 as its return value.  Its memory is shared with the
+   parent copy-on-write, and it gets its own openings of the
+   parent's executable and open files, at the same positions.
+   Returns the child's pid, or TID_ERROR if it cannot be created. */
+pid_t
+process_fork (const struct intr_frame *if_)
+{
+  struct thread *cur = thread_current ();
+  struct fork_args args;
+  // the parent waits below until the child is done with ARGS, so
+  // they can live on its stack
+
+  sema_init (&args.child_setup_sema, 0);
+  args.child_start_success = false;
+  args.parent = cur;
+  args.if_ = *if_;
+
+  tid_t tid = thread_create (cur->name, PRI_DEFAULT, start_fork, &args);
+  if (tid == TID_ERROR)
+    return TID_ERROR;
+
+  sema_down (&args.child_setup_sema);
+  if (!args.child_start_success)
+    return TID_ERROR;
+
+  list_push_back (&cur->list_of_children, &args.state->elem);
+  return tid;
+}
+
+/* A thread function that copies the process given in AUX and
+   starts running it. */
+static void
+start_fork (void *aux)
+{
+  struct fork_args *fork_args = aux;
+  struct thread *parent = fork_args->parent;
+  struct thread *cur = thread_current ();
+  struct intr_frame if_ = fork_args->if_;
+  bool success = false;
+
+  if_.eax = 0;
+
+  if (!page_table_init (&cur->pages))
+    goto done;
+  cur->pagedir = pagedir_create ();
+  if (cur->pagedir == NULL)
+    goto done;
+  process_activate ();
+
+  // the files come first, so the pages read from the parent's
+  // executable can be read from the child's
+  if (!fork_files (parent) || !page_table_fork (parent, cur->exec_file)
+      || !mmap_fork (parent))
+    goto done;
+
+  fork_args->state = init_child_state ();
+  success = fork_args->state != NULL;
+
+done:
+  if (!success)
+    {
+      // process_exit() only releases the memory of a process that
+      // never started, so the files are closed here
+      file_close (cur->exec_file);
+      cur->exec_file = NULL;
+      free_file_descriptors (cur);
+
+      fork_args->child_start_success = false;
+      sema_up (&fork_args->child_setup_sema);
+      thread_exit ();
+      NOT_REACHED ();
+    }
+
+  // we don't need lock here because parent process can't run until sema_up
+  fork_args->child_start_success = true;
+  cur->state = fork_args->state;
+  sema_up (&fork_args->child_setup_sema);
+
+  asm volatile("movl %0, %%esp; jmp intr_exit" : : "g"(&if_) : "memory");
+  NOT_REACHED ();
+}
+
+/* Gives the current process its own openings of PARENT's
+   executable and open files, with the same file descriptors and
+   positions.  The positions are not shared afterwards.
+   Returns false if a file cannot be reopened or if memory
+   allocation fails. */
+static bool
+fork_files (struct thread *parent)
+{
+  struct thread *cur = thread_current ();
+  struct list *fds = &parent->file_descriptors;
+  bool success = true;
+
+  cur->exec_file = file_reopen (parent->exec_file);
+  if (cur->exec_file == NULL)
+    success = false;
+  else
+    file_deny_write (cur->exec_file);
+
+  if (success && parent->cwd != NULL)
+    {
+      cur->cwd = dir_reopen (parent->cwd);
+      success = cur->cwd != NULL;
+    }
+
+  for (struct list_elem *e = list_begin (fds); success && e != list_end (fds);
+       e = list_next (e))
+    {
+      struct file_descriptor *parent_fd
+          = list_entry (e, struct file_descriptor, elem);
+      struct file_descriptor *fd = malloc (sizeof *fd);
+      if (fd == NULL)
+        {
+          success = false;
+          break;
+        }
+
+      fd->file = file_reopen (parent_fd->file);
+      fd->dir = NULL;
+      if (fd->file != NULL && parent_fd->dir != NULL)
+        {
+          fd->dir = dir_reopen (parent_fd->dir);
+          if (fd->dir == NULL)
+            {
+              file_close (fd->file);
+              fd->file = NULL;
+            }
+          else
+            dir_seek (fd->dir, dir_tell (parent_fd->dir));
+        }
+      if (fd->file == NULL)
+        {
+          free (fd);
+          success = false;
+          break;
+        }
+      file_seek (fd->file, file_tell (parent_fd->file));
+      fd->fd = parent_fd->fd;
+      list_push_back (&cur->file_descriptors, &fd->elem);
+    }
+
+  cur->fd_incrementor = parent->fd_incrementor;
+  return success;
+}
+#endif
+
 /* Waits for thread TID to die and returns its exit status.
  * If it was terminated by the kernel (i.e. killed due to an exception),
  * returns -1.
@@ -305,6 +493,20 @@ process_exit (void)
   struct thread *cur = thread_current ();
   uint32_t *pd;
 
+#ifdef VM
+  /* Write back memory mapped files while they are still open. */
+  mmap_unmap_all ();
+  page_table_destroy (&cur->pages);
+#endif
+
+  /* Even a process that never started may have a working
+     directory. */
+  if (cur->cwd != NULL)
+    {
+      dir_close (cur->cwd);
+      cur->cwd = NULL;
+    }
+
   /* Destroy the current process's page directory and switch back
      to the kernel-only page directory. */
   pd = cur->pagedir;
@@ -343,11 +545,9 @@ process_exit (void)
   if (parent_exited)
     free (state);
 
-  lock_acquire (&filesys_lock);
   if (cur->exec_file != NULL)
     file_allow_write (cur->exec_file);
   file_close (cur->exec_file);
-  lock_release (&filesys_lock);
 
   free_file_descriptors (cur);
   free_list_of_children (cur);
@@ -456,6 +656,12 @@ load (void *p_args, void (**eip) (void), void **esp)
   bool success = false;
   int i;
 
+#ifdef VM
+  /* Allocate supplemental page table. */
+  if (!page_table_init (&t->pages))
+    goto done;
+#endif
+
   /* Allocate and activate page directory. */
   t->pagedir = pagedir_create ();
   if (t->pagedir == NULL)
@@ -557,7 +763,9 @@ done:
 
 /* load() helpers. */
 
+#ifndef VM
 static bool install_page (void *upage, void *kpage, bool writable);
+#endif
 
 /* Checks whether PHDR describes a valid, loadable segment in
    FILE and returns true if so, false otherwise. */
@@ -626,7 +834,9 @@ load_segment (struct file *file, off_t ofs, uint8_t *upage,
   ASSERT (pg_ofs (upage) == 0);
   ASSERT (ofs % PGSIZE == 0);
 
+#ifndef VM
   file_seek (file, ofs);
+#endif
   while (read_bytes > 0 || zero_bytes > 0)
     {
       /* Calculate how to fill this page.
@@ -635,6 +845,13 @@ load_segment (struct file *file, off_t ofs, uint8_t *upage,
       size_t page_read_bytes = read_bytes < PGSIZE ? read_bytes : PGSIZE;
       size_t page_zero_bytes = PGSIZE - page_read_bytes;
 
+#ifdef VM
+      /* Only record where the page comes from, it is read in by
+         the page fault handler the first time it is touched. */
+      if (!page_add_file (upage, file, ofs, page_read_bytes, writable))
+        return false;
+      ofs += page_read_bytes;
+#else
       /* Check if virtual page already allocated */
       struct thread *t = thread_current ();
       uint8_t *kpage = pagedir_get_page (t->pagedir, upage);
@@ -664,6 +881,7 @@ load_segment (struct file *file, off_t ofs, uint8_t *upage,
           return false;
         }
       memset (kpage + page_read_bytes, 0, page_zero_bytes);
+#endif
 
       /* Advance. */
       read_bytes -= page_read_bytes;
@@ -673,85 +891,101 @@ load_segment (struct file *file, off_t ofs, uint8_t *upage,
   return true;
 }
 
+/* Maps a zeroed page at the top of user virtual memory.
+   Returns true if successful, false if memory allocation fails. */
+static bool
+map_stack_page (void)
+{
+  uint8_t *upage = ((uint8_t *)PHYS_BASE) - PGSIZE;
+#ifdef VM
+  /* The page belongs to the supplemental page table, which frees
+     its frame when the process exits. */
+  return page_add_zero (upage, true) && page_load (upage);
+#else
+  uint8_t *kpage = palloc_get_page (PAL_USER | PAL_ZERO);
+  if (kpage == NULL)
+    return false;
+  if (!install_page (upage, kpage, true))
+    {
+      palloc_free_page (kpage);
+      return false;
+    }
+  return true;
+#endif
+}
+
 /* Create a minimal stack by mapping a zeroed page at the top of
    user virtual memory. */
 static bool
 setup_stack (void **esp, struct start_process_args *process_args)
 {
-  uint8_t *kpage;
-  bool success = false;
+  bool success = map_stack_page ();
 
-  kpage = palloc_get_page (PAL_USER | PAL_ZERO);
-  if (kpage != NULL)
+  if (success)
     {
-      success = install_page (((uint8_t *)PHYS_BASE) - PGSIZE, kpage, true);
-      if (success)
+      *esp = PHYS_BASE;
+      size_t available_space = PGSIZE - 512;
+      // reserve some spaces for other functions push stack
+      // otherwise other functions may easily stack overflow
+      
+      // we have to have this limit, otherwise it cannot work with the 
+      // code already provided
+
+      /* A counter that stores the available space
+       * In the check_valid_push_stack and push_stack macro,
+       * we check whether the stack has enough space so that
+       * we can push things onto the stack.
+       * If the space is not enough, set success to false and
+       * return directly
+       */
+      // push the null separated argv
+      check_valid_push_stack (process_args->temp_for_build_stack,
+                              process_args->len_argv);
+
+      static const int nullptr = 0;
+      char *argv_ptr = PHYS_BASE - 2;
+      // zero is at the end of the stack, skip it, so PHYS_BASE - 2
+
+
+      // a little hack, make sure there are '\0's before the string
+      // despite this might not be needed since we initialize the page to all zero
+      // but this is still better to add the '\0's, because we might change the
+      // palloc flags later
+      *(((int *)*esp) - 1) = 0;
+      *esp = (void *)word_align (*esp);
+
+      // Push a null pointer 0
+      push_stack (nullptr);
+
+      // we have to use this temp due to (argv_ptr + 1) is a right value
+      // which doesn't have an address, memcpy cannot work
+      char *temp; 
+      // Push pointers to the arguments in reverse order
+      for (int i = 0; i != process_args->argc;)
         {
-          *esp = PHYS_BASE;
-          size_t available_space = PGSIZE - 512;
-          // reserve some spaces for other functions push stack
-          // otherwise other functions may easily stack overflow
-          
-          // we have to have this limit, otherwise it cannot work with the 
-          // code already provided
-
-          /* A counter that stores the available space
-           * In the check_valid_push_stack and push_stack macro,
-           * we check whether the stack has enough space so that
-           * we can push things onto the stack.
-           * If the space is not enough, set success to false and
-           * return directly
-           */
-          // push the null separated argv
-          check_valid_push_stack (process_args->temp_for_build_stack,
-                                  process_args->len_argv);
-
-          static const int nullptr = 0;
-          char *argv_ptr = PHYS_BASE - 2;
-          // zero is at the end of the stack, skip it, so PHYS_BASE - 2
-
-
-          // a little hack, make sure there are '\0's before the string
-          // despite this might not be needed since we initialize the page to all zero
-          // but this is still better to add the '\0's, because we might change the
-          // palloc flags later
-          *(((int *)*esp) - 1) = 0;
-          *esp = (void *)word_align (*esp);
-
-          // Push a null pointer 0
-          push_stack (nullptr);
-
-          // we have to use this temp due to (argv_ptr + 1) is a right value
-          // which doesn't have an address, memcpy cannot work
-          char *temp; 
-          // Push pointers to the arguments in reverse order
-          for (int i = 0; i != process_args->argc;)
+          if (*argv_ptr == '\0')
             {
-              if (*argv_ptr == '\0')
-                {
-                  temp = argv_ptr + 1;
-                  push_stack (temp);
-                  i++;
-                }
-              argv_ptr--;
+              temp = argv_ptr + 1;
+              push_stack (temp);
+              i++;
             }
+          argv_ptr--;
+        }
 
-          // Push a pointer to the first pointer
-          // not using push stack, since ambiguity in type
-          const char *previous_esp = (*esp);
-          check_valid_push_stack (&previous_esp, sizeof (char **));
+      // Push a pointer to the first pointer
+      // not using push stack, since ambiguity in type
+      const char *previous_esp = (*esp);
+      check_valid_push_stack (&previous_esp, sizeof (char **));
 
-          // push the number of arguments
-          push_stack (process_args->argc);
-          push_stack (nullptr); // push a fake return address
-        }
-      else
-        palloc_free_page (kpage);
+      // push the number of arguments
+      push_stack (process_args->argc);
+      push_stack (nullptr); // push a fake return address
     }
 done:
   return success;
 }
 
+#ifndef VM
 /* Adds a mapping from user virtual address UPAGE to kernel
    virtual address KPAGE to the page table.
    If WRITABLE is true, the user process may modify the page;
@@ -771,6 +1005,7 @@ install_page (void *upage, void *kpage, bool writable)
   return (pagedir_get_page (t->pagedir, upage) == NULL
           && pagedir_set_page (t->pagedir, upage, kpage, writable));
 }
+#endif
 
 /* Find and remove process_child_state from l and return it.
    if not found, return NULL. */
@@ -806,9 +1041,8 @@ free_file_descriptors (struct thread *t)
       struct list_elem *e = list_pop_front (&t->file_descriptors);
       struct file_descriptor *descriptor
           = list_entry (e, struct file_descriptor, elem);
-      lock_acquire (&filesys_lock);
+      dir_close (descriptor->dir);
       file_close (descriptor->file);
-      lock_release (&filesys_lock);
 
       free (descriptor);
     }
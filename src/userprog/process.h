@@ -31,6 +31,10 @@ struct process_child_state
 };
 
 tid_t process_execute (const char *file_name);
+#ifdef VM
+struct intr_frame;
+pid_t process_fork (const struct intr_frame *if_);
+#endif
 int process_wait (tid_t);
 void process_exit (void);
 void process_activate (void);
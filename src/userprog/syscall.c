@@ -1,8 +1,10 @@
 #include "userprog/syscall.h"
 #include "devices/input.h"
 #include "devices/shutdown.h"
+#include "filesys/directory.h"
 #include "filesys/file.h"
 #include "filesys/filesys.h"
+#include "filesys/inode.h"
 #include "lib/kernel/stdio.h"
 #include "lib/stdio.h"
 #include "threads/interrupt.h"
@@ -10,10 +12,21 @@
 #include "threads/synch.h"
 #include "threads/thread.h"
 #include "userprog/process.h"
+#ifdef VM
+#include "vm/mmap.h"
+#include "vm/page.h"
+#endif
 #include <list.h>
 #include <stddef.h>
 #include <syscall-nr.h>
 
+#ifdef VM
+// most bytes of a user buffer pinned at once by read and write:
+// 64 sectors, as many as the file system reads from disk with one
+// request, so large transfers still reach it in large pieces
+#define PIN_WINDOW (8 * PGSIZE)
+#endif
+
 static int sys_halt_handler (int, int, int);
 static int sys_exit_handler (int, int, int);
 static int sys_exec_handler (int, int, int);
@@ -27,6 +40,17 @@ static int sys_write_handler (int, int, int);
 static int sys_seek_handler (int, int, int);
 static int sys_tell_handler (int, int, int);
 static int sys_close_handler (int, int, int);
+static int sys_chdir_handler (int, int, int);
+static int sys_mkdir_handler (int, int, int);
+static int sys_readdir_handler (int, int, int);
+static int sys_isdir_handler (int, int, int);
+static int sys_inumber_handler (int, int, int);
+#ifdef VM
+static int sys_mmap_handler (int, int, int);
+static int sys_munmap_handler (int, int, int);
+static int sys_fork_handler (int, int, int);
+static int sys_pagestats_handler (int, int, int);
+#endif
 
 static struct file *to_file (int fd);
 static struct file_descriptor *to_file_descriptor (int fd);
@@ -34,6 +58,12 @@ static void check_safe_memory_access (const void *vaddr);
 static void check_ranged_memory (const void *start, size_t length,
                                  size_t size_of_type);
 static void check_string_memory (const char *start);
+#ifdef VM
+static void pin_buffer (const void *buffer, size_t size, bool will_write);
+static void unpin_buffer (const void *buffer, size_t size);
+static int transfer_pinned (struct file *file, void *buffer, int size,
+                            bool read);
+#endif
 
 static void syscall_handler (struct intr_frame *);
 
@@ -45,14 +75,26 @@ static syscall_func_t syscall_funcs[] = {
   [SYS_OPEN] = sys_open_handler,     [SYS_FILESIZE] = sys_filesize_handler,
   [SYS_READ] = sys_read_handler,     [SYS_WRITE] = sys_write_handler,
   [SYS_SEEK] = sys_seek_handler,     [SYS_TELL] = sys_tell_handler,
-  [SYS_CLOSE] = sys_close_handler
+  [SYS_CLOSE] = sys_close_handler,   [SYS_CHDIR] = sys_chdir_handler,
+  [SYS_MKDIR] = sys_mkdir_handler,   [SYS_READDIR] = sys_readdir_handler,
+  [SYS_ISDIR] = sys_isdir_handler,   [SYS_INUMBER] = sys_inumber_handler,
+#ifdef VM
+  [SYS_MMAP] = sys_mmap_handler,     [SYS_MUNMAP] = sys_munmap_handler,
+  [SYS_FORK] = sys_fork_handler,     [SYS_PAGESTATS] = sys_pagestats_handler,
+#endif
 };
 
 static int argc_syscall[]
     = { [SYS_HALT] = 0,   [SYS_EXIT] = 1,   [SYS_EXEC] = 1, [SYS_WAIT] = 1,
         [SYS_CREATE] = 2, [SYS_REMOVE] = 1, [SYS_OPEN] = 1, [SYS_FILESIZE] = 1,
         [SYS_READ] = 3,   [SYS_WRITE] = 3,  [SYS_SEEK] = 2, [SYS_TELL] = 1,
-        [SYS_CLOSE] = 1 };
+        [SYS_CLOSE] = 1,  [SYS_CHDIR] = 1,  [SYS_MKDIR] = 1,
+        [SYS_READDIR] = 2, [SYS_ISDIR] = 1, [SYS_INUMBER] = 1,
+#ifdef VM
+        [SYS_MMAP] = 2,   [SYS_MUNMAP] = 1,   [SYS_FORK] = 0,
+        [SYS_PAGESTATS] = 2,
+#endif
+};
 
 /* Add all the arguments from stack to output buffer */
 static void
@@ -66,7 +108,6 @@ check_and_resolve_syscall_stack (int argc, int *stack_pointer, int *output)
 void
 syscall_init (void)
 {
-  lock_init (&filesys_lock);
   intr_register_int (0x30, 3, INTR_ON, syscall_handler, "syscall");
 }
 
@@ -75,6 +116,9 @@ static void
 syscall_handler (struct intr_frame *f UNUSED)
 {
   void *stack_ptr = f->esp;
+#ifdef VM
+  thread_current ()->user_if = f;
+#endif
   check_safe_memory_access (stack_ptr);
   int sys_argv[] = { 0, 0, 0 }; // must initialize to 0 !!!
   int syscall_number = *(int32_t *)stack_ptr;
@@ -98,6 +142,16 @@ check_safe_memory_access (const void *vaddr)
 
   void *kaddr = pagedir_get_page (cur->pagedir, vaddr);
 
+#ifdef VM
+  // the page may not have been touched yet, or be a part of the stack
+  // that has not grown yet, bring it in now
+  if (kaddr == NULL
+      && (page_load (vaddr)
+          || (page_is_stack_access (vaddr, cur->user_if->esp)
+              && page_grow_stack (vaddr))))
+    return;
+#endif
+
   if (kaddr == NULL)
     exit_wrapper (-1);
 }
@@ -120,15 +174,18 @@ sys_write_handler (int fd, int buffer, int size)
   if (fd == STDIN_FILENO)
     exit_wrapper (-1);
 
-  struct file *file = to_file (fd);
-  if (file == NULL)
+  struct file_descriptor *file_descriptor = to_file_descriptor (fd);
+  if (file_descriptor == NULL)
     exit_wrapper (-1);
+  if (file_descriptor->dir != NULL)
+    return -1;
+  struct file *file = file_descriptor->file;
 
-  lock_acquire (&filesys_lock);
-  int ret = file_write (file, (const void *)buffer, (off_t)size);
-  lock_release (&filesys_lock);
-
-  return ret;
+#ifdef VM
+  return transfer_pinned (file, (void *)buffer, size, false);
+#else
+  return file_write (file, (const void *)buffer, (off_t)size);
+#endif
 }
 
 static int
@@ -172,9 +229,7 @@ sys_create_handler (int file_name, int size, int arg2 UNUSED)
 {
   check_string_memory ((const char *)file_name);
 
-  lock_acquire (&filesys_lock);
   bool output = filesys_create ((const char *)file_name, (off_t)size);
-  lock_release (&filesys_lock);
 
   return (int)output;
 }
@@ -186,9 +241,7 @@ sys_remove_handler (int file_name, int arg1 UNUSED, int arg2 UNUSED)
 {
   check_string_memory ((const char *)file_name);
 
-  lock_acquire (&filesys_lock);
   bool output = filesys_remove ((const char *)file_name);
-  lock_release (&filesys_lock);
 
   return (int)output;
 }
@@ -205,9 +258,18 @@ sys_open_handler (int file_name, int arg1 UNUSED, int arg2 UNUSED)
   if (!file_descriptor)
     exit_wrapper (-1);
 
-  lock_acquire (&filesys_lock);
   struct file *file = filesys_open ((const char *)file_name);
-  lock_release (&filesys_lock);
+  struct dir *dir = NULL;
+  if (file != NULL && inode_is_dir (file_get_inode (file)))
+    {
+      // directories are read with readdir, which needs its own position
+      dir = dir_open (inode_reopen (file_get_inode (file)));
+      if (dir == NULL)
+        {
+          file_close (file);
+          file = NULL;
+        }
+    }
 
   if (!file)
     {
@@ -217,6 +279,7 @@ sys_open_handler (int file_name, int arg1 UNUSED, int arg2 UNUSED)
 
   struct thread *cur = thread_current ();
   file_descriptor->file = file;
+  file_descriptor->dir = dir;
   file_descriptor->fd = cur->fd_incrementor++;
   list_push_back (&cur->file_descriptors, &file_descriptor->elem);
   // only one thread can access to its file descriptor list, thus
@@ -235,10 +298,7 @@ sys_filesize_handler (int fd, int arg1 UNUSED, int arg2 UNUSED)
   if (file == NULL)
     return -1;
 
-  lock_acquire (&filesys_lock);
-  int ret = file_length (file);
-  lock_release (&filesys_lock);
-  return ret;
+  return file_length (file);
 }
 
 /* Read the file open as fd into buffer given the size bytes
@@ -259,14 +319,16 @@ sys_read_handler (int fd, int buffer, int size)
     }
   // read the stdin into buffer.
 
-  struct file *file = to_file (fd);
-  if (!file)
+  struct file_descriptor *file_descriptor = to_file_descriptor (fd);
+  if (!file_descriptor || file_descriptor->dir != NULL)
     return -1;
+  struct file *file = file_descriptor->file;
 
-  lock_acquire (&filesys_lock);
-  int ret = file_read (file, (char *)buffer, size);
-  lock_release (&filesys_lock);
-  return ret;
+#ifdef VM
+  return transfer_pinned (file, (void *)buffer, size, true);
+#else
+  return file_read (file, (char *)buffer, size);
+#endif
 }
 
 /* Get the file with the given fd and call file_seek to set the next
@@ -281,9 +343,7 @@ sys_seek_handler (int fd, int position, int arg2 UNUSED)
   if (!file)
     return 0; 
 
-  lock_acquire (&filesys_lock);
   file_seek (file, position);
-  lock_release (&filesys_lock);
   return 0;
 }
 
@@ -298,9 +358,7 @@ sys_tell_handler (int fd, int arg1 UNUSED, int arg2 UNUSED)
   if (!file)
     return 0; 
 
-  lock_acquire (&filesys_lock);
   file_tell (file);
-  lock_release (&filesys_lock);
   return 0;
 }
 
@@ -312,9 +370,8 @@ sys_close_handler (int fd, int arg1 UNUSED, int arg2 UNUSED)
   if (!file_descriptor)
     return 0;
 
-  lock_acquire (&filesys_lock);
+  dir_close (file_descriptor->dir);
   file_close (file_descriptor->file);
-  lock_release (&filesys_lock);
 
   list_remove (&file_descriptor->elem);
   free (file_descriptor);
@@ -322,6 +379,124 @@ sys_close_handler (int fd, int arg1 UNUSED, int arg2 UNUSED)
   return 0;
 }
 
+/* Change the working directory of the process to dir */
+static int
+sys_chdir_handler (int dir, int arg1 UNUSED, int arg2 UNUSED)
+{
+  check_string_memory ((const char *)dir);
+
+  bool output = filesys_chdir ((const char *)dir);
+
+  return (int)output;
+}
+
+/* Create the directory dir, which must not already exist */
+static int
+sys_mkdir_handler (int dir, int arg1 UNUSED, int arg2 UNUSED)
+{
+  check_string_memory ((const char *)dir);
+
+  bool output = filesys_mkdir ((const char *)dir);
+
+  return (int)output;
+}
+
+/* Read the next entry of the directory open as fd into name, skipping
+  "." and "..", and return false once there are no more entries or if fd
+  is not a directory */
+static int
+sys_readdir_handler (int fd, int name, int arg2 UNUSED)
+{
+  char entry[NAME_MAX + 1];
+
+  check_ranged_memory ((char *)name, NAME_MAX + 1, sizeof (char));
+
+  struct file_descriptor *file_descriptor = to_file_descriptor (fd);
+  if (!file_descriptor || file_descriptor->dir == NULL)
+    return false;
+
+  bool output = dir_readdir (file_descriptor->dir, entry);
+
+  if (output)
+    {
+#ifdef VM
+      pin_buffer ((void *)name, sizeof entry, true);
+#endif
+      strlcpy ((char *)name, entry, sizeof entry);
+#ifdef VM
+      unpin_buffer ((void *)name, sizeof entry);
+#endif
+    }
+  return (int)output;
+}
+
+/* Return whether fd is open on a directory */
+static int
+sys_isdir_handler (int fd, int arg1 UNUSED, int arg2 UNUSED)
+{
+  struct file_descriptor *file_descriptor = to_file_descriptor (fd);
+  if (!file_descriptor)
+    return false;
+
+  return file_descriptor->dir != NULL;
+}
+
+/* Return the inode number of the file or directory open as fd */
+static int
+sys_inumber_handler (int fd, int arg1 UNUSED, int arg2 UNUSED)
+{
+  struct file *file = to_file (fd);
+  if (!file)
+    return -1;
+
+  return inode_get_inumber (file_get_inode (file));
+}
+
+#ifdef VM
+/* Map the file open as fd into the process's address space at addr */
+static int
+sys_mmap_handler (int fd, int addr, int arg2 UNUSED)
+{
+  struct file *file = to_file (fd);
+  if (!file)
+    return MAP_FAILED;
+
+  return mmap_map (file, (void *)addr);
+}
+
+/* Unmap the mapping, writing back the pages that were modified */
+static int
+sys_munmap_handler (int mapping, int arg1 UNUSED, int arg2 UNUSED)
+{
+  mmap_unmap ((mapid_t)mapping);
+  return 0;
+}
+
+/* Create a copy of the current process that shares its memory
+   copy-on-write, returning 0 in the child */
+static int
+sys_fork_handler (int arg0 UNUSED, int arg1 UNUSED, int arg2 UNUSED)
+{
+  return process_fork (thread_current ()->user_if);
+}
+
+/* Copy the paging statistics of the process, or of the whole
+   system if system is true, to stats */
+static int
+sys_pagestats_handler (int stats, int system, int arg2 UNUSED)
+{
+  struct pagestats copy;
+
+  check_ranged_memory ((void *)stats, 1, sizeof copy);
+  page_get_stats (&copy, system);
+
+  pin_buffer ((void *)stats, sizeof copy, true);
+  memcpy ((void *)stats, &copy, sizeof copy);
+  unpin_buffer ((void *)stats, sizeof copy);
+  return 0;
+}
+#endif
+
 // find file according to fd in current thread
 // if fd not exist, return NULL
 struct file *
@@ -427,4 +602,64 @@ check_ranged_memory (const void *start, size_t length, size_t size_of_type)
   // otherwise
   // start is checked, and all the boundaries are checked
   // check_until is not checked
-}
\ No newline at end of file
+}
+#ifdef VM
+// bring in and pin every page of the buffer, so that the file system
+// never faults on it while holding an inode's lock: bringing in or
+// evicting a memory mapped page may need that same lock
+// exit(-1) if a page is not mapped, or is read-only and WILL_WRITE
+static void
+pin_buffer (const void *buffer, size_t size, bool will_write)
+{
+  const uint8_t *start = pg_round_down (buffer);
+  const uint8_t *end = (const uint8_t *)buffer + size;
+
+  for (const uint8_t *upage = start; upage < end; upage += PGSIZE)
+    if (!page_pin (upage, will_write))
+      {
+        for (const uint8_t *pinned = start; pinned < upage; pinned += PGSIZE)
+          page_unpin (pinned);
+        exit_wrapper (-1);
+      }
+}
+
+// undo pin_buffer
+static void
+unpin_buffer (const void *buffer, size_t size)
+{
+  const uint8_t *start = pg_round_down (buffer);
+  const uint8_t *end = (const uint8_t *)buffer + size;
+
+  for (const uint8_t *upage = start; upage < end; upage += PGSIZE)
+    page_unpin (upage);
+}
+
+// read FILE into BUFFER, or write BUFFER to FILE, PIN_WINDOW bytes of
+// the buffer at a time, so that a large buffer never holds more than
+// a few pinned frames
+// stops at the first short transfer; returns the bytes transferred
+static int
+transfer_pinned (struct file *file, void *buffer, int size, bool read)
+{
+  uint8_t *pos = buffer;
+  int done = 0;
+
+  while (done < size)
+    {
+      int chunk = PIN_WINDOW - pg_ofs (pos);
+      if (chunk > size - done)
+        chunk = size - done;
+
+      pin_buffer (pos, chunk, read);
+      int ret = read ? file_read (file, pos, chunk)
+                     : file_write (file, pos, chunk);
+      unpin_buffer (pos, chunk);
+
+      done += ret;
+      pos += ret;
+      if (ret < chunk)
+        break;
+    }
+  return done;
+}
+#endif
@@ -9,13 +9,13 @@
 #include "../threads/vaddr.h"
 #include <list.h>
 
-struct lock filesys_lock;
 
 /* Structure to store the correspondence fd for each file */
 struct file_descriptor
 {
     int fd;                 /* A unique indicator for each use of file */
     struct file * file;     /* A pointer to the file indicated to */
+    struct dir * dir;       /* The directory, if the file is one */
     struct list_elem elem;  /* Threads that opens the file */
 };
 
@@ -0,0 +1,425 @@
+#include "vm/frame.h"
+#include "threads/loader.h"
+#include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/thread.h"
+#include "userprog/pagedir.h"
+#include "vm/page.h"
+#include "vm/swap.h"
+#include <debug.h>
+
+/* Number of times frame_alloc_and_lock() scans the whole table
+   before giving up. */
+#define ALLOC_ATTEMPTS 3
+
+/* Every frame of the user pool, obtained once at boot. */
+static struct frame *frames;
+static size_t frame_cnt;
+
+/* Serializes scans of the table. */
+static struct lock scan_lock;
+
+/* Frames that no page occupies.  A frame is put here by
+   frame_free() and taken off by alloc_free_frame(), so that
+   allocation only sweeps the table when memory is full. */
+static struct list free_frames;
+static struct lock free_lock;
+
+/* Clock hand: next frame to consider for eviction. */
+static size_t hand;
+
+/* Frames holding read-only pages of executables, by inode sector
+   and offset, so that processes running the same program share
+   its code.  Frames stay in the table until they are freed. */
+static struct hash text_frames;
+static struct lock text_lock;
+
+static bool try_lock (struct frame *f);
+static void occupy (struct frame *f, struct page *page);
+static bool accessed_recently (struct frame *f);
+static bool is_dirty (struct frame *f);
+static void forget_text (struct frame *f);
+static unsigned text_hash (const struct hash_elem *e, void *aux);
+static bool text_less (const struct hash_elem *a, const struct hash_elem *b,
+                       void *aux);
+static struct frame *alloc_free_frame (struct page *page);
+static struct frame *try_frame_alloc_and_lock (struct page *page);
+static size_t collect_victims (struct frame *f, struct frame **victims);
+static bool evict (struct frame **victims, size_t cnt);
+
+/* Takes every page of the user pool into the frame table. */
+void
+frame_init (void)
+{
+  void *kpage;
+
+  lock_init (&scan_lock);
+  lock_init (&free_lock);
+  list_init (&free_frames);
+  lock_init (&text_lock);
+  if (!hash_init (&text_frames, text_hash, text_less, NULL))
+    PANIC ("out of memory allocating frame table");
+
+  frames = malloc (sizeof *frames * init_ram_pages);
+  if (frames == NULL)
+    PANIC ("out of memory allocating frame table");
+
+  while ((kpage = palloc_get_page (PAL_USER)) != NULL)
+    {
+      struct frame *f = &frames[frame_cnt++];
+      lock_init (&f->lock);
+      f->kpage = kpage;
+      list_init (&f->pages);
+      f->dirty = false;
+      f->is_text = false;
+      list_push_back (&free_frames, &f->free_elem);
+    }
+}
+
+/* Locks F if no other thread holds it.  Frames the current thread
+   already holds, such as pinned pages, are skipped too. */
+static bool
+try_lock (struct frame *f)
+{
+  return !lock_held_by_current_thread (&f->lock)
+         && lock_try_acquire (&f->lock);
+}
+
+/* Takes a frame off the free list for PAGE.
+   Returns the frame locked, or NULL if the list is empty. */
+static struct frame *
+alloc_free_frame (struct page *page)
+{
+  struct frame *f = NULL;
+
+  lock_acquire (&free_lock);
+  if (!list_empty (&free_frames))
+    f = list_entry (list_pop_front (&free_frames), struct frame, free_elem);
+  lock_release (&free_lock);
+
+  if (f != NULL)
+    {
+      /* Someone checking whether one of its pages is still here
+         may hold the lock for a moment. */
+      lock_acquire (&f->lock);
+      occupy (f, page);
+    }
+  return f;
+}
+
+/* Tries to find a frame for PAGE, evicting another page with
+   the clock algorithm if no frame is free.
+   Returns the frame locked, or NULL if none could be found. */
+static struct frame *
+try_frame_alloc_and_lock (struct page *page)
+{
+  struct frame *f = alloc_free_frame (page);
+  size_t i;
+
+  if (f != NULL)
+    return f;
+
+  /* No free frame.  Sweep the clock hand over the table, giving
+     every recently accessed page a second chance.  Two full turns
+     are enough to find a victim unless all frames are busy. */
+  lock_acquire (&scan_lock);
+  for (i = 0; i < frame_cnt * 2; i++)
+    {
+      f = &frames[hand];
+      if (++hand >= frame_cnt)
+        hand = 0;
+
+      if (!try_lock (f))
+        continue;
+
+      /* A frame no page occupies is on the free list, or was just
+         taken off it by another thread. */
+      if (list_empty (&f->pages))
+        {
+          lock_release (&f->lock);
+          continue;
+        }
+
+      if (accessed_recently (f))
+        {
+          lock_release (&f->lock);
+          continue;
+        }
+
+      /* Write the victims out without holding up other scans. */
+      struct frame *victims[SWAP_BATCH_PAGES];
+      size_t victim_cnt = collect_victims (f, victims);
+      lock_release (&scan_lock);
+      if (!evict (victims, victim_cnt))
+        {
+          lock_release (&f->lock);
+          lock_acquire (&scan_lock);
+          continue;
+        }
+
+      occupy (f, page);
+      return f;
+    }
+
+  lock_release (&scan_lock);
+  return NULL;
+}
+
+/* Stores F into VICTIMS, followed by up to SWAP_BATCH_PAGES - 1
+   frames the clock hand would pick next, so that modified pages
+   reach swap in one batch of adjacent slots.  Extra frames are
+   only taken if F's page and theirs are modified, since clean
+   pages cost nothing to evict later.  Returns the number of
+   frames stored, all locked by the current thread.
+   Must be called with scan_lock held. */
+static size_t
+collect_victims (struct frame *f, struct frame **victims)
+{
+  size_t cnt = 0;
+
+  victims[cnt++] = f;
+  if (!is_dirty (f))
+    return cnt;
+
+  /* Never wrap around to a frame we already hold. */
+  for (size_t i = 0;
+       i < SWAP_BATCH_PAGES * 2 && i + 1 < frame_cnt
+       && cnt < SWAP_BATCH_PAGES;
+       i++)
+    {
+      struct frame *g = &frames[hand];
+      if (++hand >= frame_cnt)
+        hand = 0;
+
+      if (!try_lock (g))
+        continue;
+      if (!list_empty (&g->pages) && !accessed_recently (g) && is_dirty (g))
+        victims[cnt++] = g;
+      else
+        lock_release (&g->lock);
+    }
+  return cnt;
+}
+
+/* Evicts the pages in the CNT locked frames VICTIMS.  All but the
+   first frame are freed, or just unlocked if their pages could not
+   be evicted.  Returns true if the first frame's pages were
+   evicted, in which case the first frame stays locked. */
+static bool
+evict (struct frame **victims, size_t cnt)
+{
+  page_out (victims, cnt);
+
+  for (size_t i = 1; i < cnt; i++)
+    if (list_empty (&victims[i]->pages))
+      frame_free (victims[i]);
+    else
+      frame_unlock (victims[i]);
+  return list_empty (&victims[0]->pages);
+}
+
+/* Returns a locked frame for PAGE, evicting if necessary, or NULL
+   if every frame is busy or holds a page that cannot be evicted.
+   Frames locked by other threads may be released shortly, so a
+   few attempts are made before giving up. */
+struct frame *
+frame_alloc_and_lock (struct page *page)
+{
+  for (int attempt = 0; attempt < ALLOC_ATTEMPTS; attempt++)
+    {
+      struct frame *f = try_frame_alloc_and_lock (page);
+      if (f != NULL)
+        {
+          ASSERT (lock_held_by_current_thread (&f->lock));
+          return f;
+        }
+      thread_yield ();
+    }
+  return NULL;
+}
+
+/* Locks PAGE's frame into memory, if it has one.
+   Upon return, PAGE->frame is either NULL or locked by the
+   current thread, so it cannot be evicted. */
+void
+frame_lock (struct page *page)
+{
+  /* The frame may be evicted while we wait for its lock, in
+     which case the page no longer occupies it. */
+  struct frame *f = page->frame;
+  if (f != NULL)
+    {
+      lock_acquire (&f->lock);
+      if (f != page->frame)
+        {
+          lock_release (&f->lock);
+          ASSERT (page->frame == NULL);
+        }
+    }
+}
+
+/* Unlocks FRAME, allowing it to be evicted.
+   FRAME must be locked by the current thread. */
+void
+frame_unlock (struct frame *frame)
+{
+  ASSERT (lock_held_by_current_thread (&frame->lock));
+  lock_release (&frame->lock);
+}
+
+/* Releases FRAME for use by another page and unlocks it.
+   FRAME must be locked by the current thread. */
+void
+frame_free (struct frame *frame)
+{
+  ASSERT (lock_held_by_current_thread (&frame->lock));
+  forget_text (frame);
+  list_init (&frame->pages);
+  frame->dirty = false;
+
+  lock_acquire (&free_lock);
+  list_push_back (&free_frames, &frame->free_elem);
+  lock_release (&free_lock);
+  lock_release (&frame->lock);
+}
+
+/* Returns true if more than one page occupies FRAME. */
+bool
+frame_is_shared (struct frame *frame)
+{
+  return !list_empty (&frame->pages)
+         && list_front (&frame->pages) != list_back (&frame->pages);
+}
+
+/* Finds the frame holding the page at offset OFS of the
+   executable whose inode is at SECTOR, if one is resident, and
+   adds PAGE to the pages occupying it.
+   Returns the frame locked by the current thread, or NULL if the
+   page is not resident. */
+struct frame *
+frame_share_text (block_sector_t sector, off_t ofs, struct page *page)
+{
+  struct frame key;
+  key.text_sector = sector;
+  key.text_ofs = ofs;
+
+  lock_acquire (&text_lock);
+  struct hash_elem *e = hash_find (&text_frames, &key.text_elem);
+  lock_release (&text_lock);
+  if (e == NULL)
+    return NULL;
+
+  /* The frame may be evicted while we wait for its lock. */
+  struct frame *f = hash_entry (e, struct frame, text_elem);
+  if (lock_held_by_current_thread (&f->lock))
+    return NULL;
+  lock_acquire (&f->lock);
+  if (!f->is_text || f->text_sector != sector || f->text_ofs != ofs
+      || list_empty (&f->pages))
+    {
+      lock_release (&f->lock);
+      return NULL;
+    }
+
+  list_push_back (&f->pages, &page->frame_elem);
+  return f;
+}
+
+/* Records that FRAME, which is locked, holds the read-only page
+   at offset OFS of the executable whose inode is at SECTOR, so
+   that other processes can share it.  Does nothing if another
+   frame already holds that page. */
+void
+frame_set_text (struct frame *frame, block_sector_t sector, off_t ofs)
+{
+  ASSERT (lock_held_by_current_thread (&frame->lock));
+  ASSERT (!frame->is_text);
+
+  frame->text_sector = sector;
+  frame->text_ofs = ofs;
+
+  lock_acquire (&text_lock);
+  frame->is_text = hash_insert (&text_frames, &frame->text_elem) == NULL;
+  lock_release (&text_lock);
+}
+
+/* Removes F, which is locked, from the table of text frames. */
+static void
+forget_text (struct frame *f)
+{
+  if (!f->is_text)
+    return;
+
+  lock_acquire (&text_lock);
+  hash_delete (&text_frames, &f->text_elem);
+  f->is_text = false;
+  lock_release (&text_lock);
+}
+
+/* Makes PAGE the only page occupying F, which is locked. */
+static void
+occupy (struct frame *f, struct page *page)
+{
+  forget_text (f);
+  list_init (&f->pages);
+  list_push_back (&f->pages, &page->frame_elem);
+  f->dirty = false;
+}
+
+/* Returns true if any page occupying F has been accessed since the
+   last call, and clears the accessed bits so the pages must be
+   touched again to count as recent.  F must be locked. */
+static bool
+accessed_recently (struct frame *f)
+{
+  bool accessed = false;
+
+  for (struct list_elem *e = list_begin (&f->pages); e != list_end (&f->pages);
+       e = list_next (e))
+    {
+      struct page *p = list_entry (e, struct page, frame_elem);
+      uint32_t *pd = p->owner->pagedir;
+      if (pagedir_is_accessed (pd, p->upage))
+        {
+          pagedir_set_accessed (pd, p->upage, false);
+          accessed = true;
+        }
+    }
+  return accessed;
+}
+
+/* Returns true if F's contents were modified since they were
+   brought in.  F must be locked. */
+static bool
+is_dirty (struct frame *f)
+{
+  if (f->dirty)
+    return true;
+
+  for (struct list_elem *e = list_begin (&f->pages); e != list_end (&f->pages);
+       e = list_next (e))
+    {
+      struct page *p = list_entry (e, struct page, frame_elem);
+      if (pagedir_is_dirty (p->owner->pagedir, p->upage))
+        return true;
+    }
+  return false;
+}
+
+static unsigned
+text_hash (const struct hash_elem *e, void *aux UNUSED)
+{
+  const struct frame *f = hash_entry (e, struct frame, text_elem);
+  return hash_int (f->text_sector) ^ hash_int (f->text_ofs);
+}
+
+static bool
+text_less (const struct hash_elem *a, const struct hash_elem *b,
+           void *aux UNUSED)
+{
+  const struct frame *fa = hash_entry (a, struct frame, text_elem);
+  const struct frame *fb = hash_entry (b, struct frame, text_elem);
+  if (fa->text_sector != fb->text_sector)
+    return fa->text_sector < fb->text_sector;
+  return fa->text_ofs < fb->text_ofs;
+}
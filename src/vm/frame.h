@@ -0,0 +1,44 @@
+#ifndef VM_FRAME_H
+#define VM_FRAME_H
+
+#include "devices/block.h"
+#include "filesys/off_t.h"
+#include "threads/synch.h"
+#include <hash.h>
+#include <list.h>
+#include <stdbool.h>
+
+struct page;
+
+/* A physical frame from the user pool.
+   Several pages may share a frame after fork(), each mapping it
+   read-only until it is written to, and processes running the
+   same executable share the frames of its read-only pages. */
+struct frame
+{
+  struct lock lock;  /* Held while the frame is filled, evicted or freed. */
+  void *kpage;       /* Kernel virtual address of the frame. */
+  struct list pages; /* Pages occupying the frame, empty if free. */
+  bool dirty;        /* Modified through a mapping that is gone. */
+  struct list_elem free_elem; /* Element in the free frame list. */
+
+  /* Only meaningful if IS_TEXT is true. */
+  bool is_text;               /* Holds a read-only executable page? */
+  block_sector_t text_sector; /* Inode sector of the executable. */
+  off_t text_ofs;             /* Offset of the page in the executable. */
+  struct hash_elem text_elem; /* Element in the table of text frames. */
+};
+
+void frame_init (void);
+
+struct frame *frame_alloc_and_lock (struct page *page);
+void frame_lock (struct page *page);
+void frame_unlock (struct frame *frame);
+void frame_free (struct frame *frame);
+bool frame_is_shared (struct frame *frame);
+
+struct frame *frame_share_text (block_sector_t sector, off_t ofs,
+                                struct page *page);
+void frame_set_text (struct frame *frame, block_sector_t sector, off_t ofs);
+
+#endif /* vm/frame.h */
@@ -0,0 +1,182 @@
+#include "vm/mmap.h"
+#include "filesys/file.h"
+#include "threads/malloc.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+#include "userprog/syscall.h"
+#include "vm/page.h"
+#include <list.h>
+#include <round.h>
+
+/* A memory mapped file. */
+struct mapping
+{
+  mapid_t id;            /* Identifier returned to the process. */
+  struct file *file;     /* Private reopening of the mapped file. */
+  uint8_t *addr;         /* First mapped page. */
+  off_t length;          /* Number of mapped bytes. */
+  size_t page_cnt;       /* Number of mapped pages. */
+  struct list_elem elem; /* Element in thread's `mappings' list. */
+};
+
+static struct mapping *to_mapping (mapid_t id);
+static bool map_pages (struct mapping *m);
+static void unmap (struct mapping *m);
+
+/* Maps FILE, which must be open, at user address ADDR in the
+   current process.  Pages are read in on first access and
+   written back only if modified, on munmap, eviction or exit.
+   Returns the new mapping's identifier, or MAP_FAILED if ADDR is
+   null or not page aligned, if the file is empty, if the range
+   reaches kernel space, or if any page of the range is already in
+   use. */
+mapid_t
+mmap_map (struct file *file, void *addr)
+{
+  struct thread *cur = thread_current ();
+  uint8_t *upage = addr;
+
+  if (upage == NULL || pg_ofs (upage) != 0 || !is_user_vaddr (upage))
+    return MAP_FAILED;
+
+  struct mapping *m = malloc (sizeof *m);
+  if (m == NULL)
+    return MAP_FAILED;
+
+  // the mapping outlives the file descriptor, so it gets its own file
+  m->file = file_reopen (file);
+  m->length = m->file != NULL ? file_length (m->file) : 0;
+
+  m->addr = upage;
+  m->page_cnt = DIV_ROUND_UP (m->length, PGSIZE);
+  // UPAGE is below PHYS_BASE, so this is the number of user pages
+  // from UPAGE on, and the last mapped page must be one of them
+  if (m->length == 0
+      || (size_t)((uint8_t *)PHYS_BASE - upage) / PGSIZE < m->page_cnt
+      || !map_pages (m))
+    goto fail;
+
+  m->id = cur->mapid_incrementor++;
+  list_push_back (&cur->mappings, &m->elem);
+  // only the owning thread accesses its mappings, no lock needed
+  return m->id;
+
+fail:
+  file_close (m->file);
+  free (m);
+  return MAP_FAILED;
+}
+
+/* Gives the current process, a child being forked from PARENT,
+   the same mappings as PARENT, with the same identifiers.  Unlike
+   the rest of the address space, mapped pages are not shared: the
+   child reads the files afresh, after page_table_fork() wrote back
+   PARENT's modified pages.
+   Returns false if memory allocation fails, leaving the mappings
+   made so far to mmap_unmap_all(). */
+bool
+mmap_fork (struct thread *parent)
+{
+  struct thread *cur = thread_current ();
+  struct list *mappings = &parent->mappings;
+
+  for (struct list_elem *e = list_begin (mappings); e != list_end (mappings);
+       e = list_next (e))
+    {
+      struct mapping *pm = list_entry (e, struct mapping, elem);
+      struct mapping *m = malloc (sizeof *m);
+      if (m == NULL)
+        return false;
+
+      m->file = file_reopen (pm->file);
+
+      m->id = pm->id;
+      m->addr = pm->addr;
+      m->length = pm->length;
+      m->page_cnt = pm->page_cnt;
+      if (m->file == NULL || !map_pages (m))
+        {
+          file_close (m->file);
+          free (m);
+          return false;
+        }
+      list_push_back (&cur->mappings, &m->elem);
+    }
+
+  cur->mapid_incrementor = parent->mapid_incrementor;
+  return true;
+}
+
+/* Removes MAPPING from the current process, writing modified
+   pages back to the file.  Does nothing if there is no such
+   mapping. */
+void
+mmap_unmap (mapid_t mapping)
+{
+  struct mapping *m = to_mapping (mapping);
+  if (m != NULL)
+    unmap (m);
+}
+
+/* Removes every mapping of the current process, as on exit. */
+void
+mmap_unmap_all (void)
+{
+  struct list *mappings = &thread_current ()->mappings;
+  while (!list_empty (mappings))
+    unmap (list_entry (list_front (mappings), struct mapping, elem));
+}
+
+/* Adds the pages of M to the current process.  Returns false if
+   a page is already in use or if memory allocation fails, in
+   which case no page is added. */
+static bool
+map_pages (struct mapping *m)
+{
+  size_t i;
+
+  for (i = 0; i < m->page_cnt; i++)
+    {
+      off_t ofs = i * PGSIZE;
+      size_t read_bytes = m->length - ofs < PGSIZE ? m->length - ofs : PGSIZE;
+      if (!page_add_mmap (m->addr + ofs, m->file, ofs, read_bytes))
+        break;
+    }
+  if (i == m->page_cnt)
+    return true;
+
+  // undo the pages added so far, nothing has been read in yet
+  while (i-- > 0)
+    page_remove (m->addr + i * PGSIZE);
+  return false;
+}
+
+/* Unmaps and frees M. */
+static void
+unmap (struct mapping *m)
+{
+  for (size_t i = 0; i < m->page_cnt; i++)
+    page_remove (m->addr + i * PGSIZE);
+
+  file_close (m->file);
+
+  list_remove (&m->elem);
+  free (m);
+}
+
+/* Returns the current thread's mapping with the given ID, or NULL
+   if there is none. */
+static struct mapping *
+to_mapping (mapid_t id)
+{
+  struct list *mappings = &thread_current ()->mappings;
+  for (struct list_elem *e = list_begin (mappings); e != list_end (mappings);
+       e = list_next (e))
+    {
+      struct mapping *m = list_entry (e, struct mapping, elem);
+      if (m->id == id)
+        return m;
+    }
+  return NULL;
+}
@@ -0,0 +1,18 @@
+#ifndef VM_MMAP_H
+#define VM_MMAP_H
+
+#include <stdbool.h>
+
+struct file;
+struct thread;
+
+/* Map region identifier. */
+typedef int mapid_t;
+#define MAP_FAILED ((mapid_t)-1)
+
+mapid_t mmap_map (struct file *file, void *addr);
+void mmap_unmap (mapid_t mapping);
+void mmap_unmap_all (void);
+bool mmap_fork (struct thread *parent);
+
+#endif /* vm/mmap.h */
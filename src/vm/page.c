@@ -0,0 +1,815 @@
+#include "vm/page.h"
+#include "devices/timer.h"
+#include "filesys/file.h"
+#include "filesys/inode.h"
+#include "threads/interrupt.h"
+#include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+#include "userprog/pagedir.h"
+#include "userprog/syscall.h"
+#include "vm/frame.h"
+#include "vm/swap.h"
+#include <debug.h>
+#include <stdio.h>
+#include <string.h>
+
+/* Number of bytes PUSHA pushes below the stack pointer before
+   updating it, the furthest a valid stack access can be below. */
+#define PUSHA_BYTES 32
+
+/* Most pages brought in ahead of a fault on a file page. */
+#define FAULT_AROUND_MAX 16
+
+/* Maximum number of pages in a process's stack.  Set with the
+   kernel command-line option -stk, between 1 and
+   STACK_PAGE_LIMIT_MAX. */
+size_t stack_page_limit = STACK_PAGE_LIMIT;
+
+/* A page of zeros, mapped read-only for every PAGE_ZERO page that
+   has been read but never written.  Such a page has no frame. */
+static void *zero_kpage;
+
+/* Paging activity of the whole system. */
+static struct pagestats system_stats;
+
+/* Adds N to counter FIELD of the current process's and of the
+   system's paging statistics.  Interrupts are disabled so that
+   updates from different threads are not lost. */
+#define COUNT(FIELD, N)                                                       \
+  do                                                                          \
+    {                                                                         \
+      enum intr_level old_level = intr_disable ();                            \
+      thread_current ()->pagestats.FIELD += (N);                              \
+      system_stats.FIELD += (N);                                              \
+      intr_set_level (old_level);                                             \
+    }                                                                         \
+  while (0)
+
+static unsigned page_hash (const struct hash_elem *e, void *aux);
+static bool page_less (const struct hash_elem *a, const struct hash_elem *b,
+                       void *aux);
+static void page_free (struct hash_elem *e, void *aux);
+static struct page *page_create (void *upage, bool writable);
+static bool page_read_in (struct page *p, void *kpage);
+static bool page_map_zero (const void *uaddr);
+static void page_fault_around (const void *uaddr);
+static bool page_copy_on_write (const void *uaddr);
+static bool page_in (struct page *p);
+static bool page_map (struct page *p);
+static void page_detach (struct page *p);
+static bool page_unshare (struct page *p);
+static void page_drop_frame (struct frame *f);
+static void page_sync (struct page *p);
+static void page_write_back (struct page *p);
+static void page_discard (struct page *p);
+
+/* Allocates the shared page of zeros. */
+void
+page_init (void)
+{
+  zero_kpage = palloc_get_page (PAL_ASSERT | PAL_ZERO);
+}
+
+/* Copies the paging statistics of the current process, or of the
+   whole system if SYSTEM is true, to STATS. */
+void
+page_get_stats (struct pagestats *stats, bool system)
+{
+  enum intr_level old_level = intr_disable ();
+  *stats = system ? system_stats : thread_current ()->pagestats;
+  intr_set_level (old_level);
+}
+
+/* Prints the paging statistics of the whole system. */
+void
+page_print_stats (void)
+{
+  struct pagestats s;
+
+  page_get_stats (&s, true);
+  printf ("Paging: %llu minor faults, %llu major faults, "
+          "%llu ticks in faults\n",
+          s.minor_faults, s.major_faults, s.fault_ticks);
+  printf ("Paging: %llu file reads, %llu swap ins, %llu swap outs, "
+          "%llu writebacks, %llu evictions\n",
+          s.file_reads, s.swap_ins, s.swap_outs, s.writebacks, s.evictions);
+}
+
+/* Initializes PAGES as an empty supplemental page table.
+   Returns false if memory allocation fails. */
+bool
+page_table_init (struct hash *pages)
+{
+  return hash_init (pages, page_hash, page_less, NULL);
+}
+
+/* Frees every entry of PAGES and the table itself, returning
+   resident frames to the frame table and unmapping them so that
+   pagedir_destroy() leaves them alone.
+   Does nothing if PAGES was never initialized, which is the case
+   for kernel threads and processes that failed early in load(). */
+void
+page_table_destroy (struct hash *pages)
+{
+  if (pages->buckets == NULL)
+    return;
+  hash_destroy (pages, page_free);
+  pages->buckets = NULL;
+}
+
+/* Returns the current thread's supplemental page table entry for
+   the page containing UADDR, or NULL if there is none. */
+struct page *
+page_lookup (const void *uaddr)
+{
+  struct page key;
+  key.upage = pg_round_down (uaddr);
+
+  struct hash_elem *e = hash_find (&thread_current ()->pages, &key.elem);
+  return e != NULL ? hash_entry (e, struct page, elem) : NULL;
+}
+
+/* Records that UPAGE is to be filled lazily with READ_BYTES bytes
+   of FILE starting at OFS, followed by zeros up to the end of the
+   page.  A page with no bytes to read becomes a PAGE_ZERO page.
+   Two ELF segments may share a page, in which case the source
+   covering more of the page wins and the page is writable if
+   either segment is.
+   Returns false if memory allocation fails. */
+bool
+page_add_file (void *upage, struct file *file, off_t ofs, size_t read_bytes,
+               bool writable)
+{
+  ASSERT (read_bytes <= PGSIZE);
+
+  struct page *p = page_lookup (upage);
+  if (p == NULL)
+    {
+      p = page_create (upage, writable);
+      if (p == NULL)
+        return false;
+    }
+  else
+    {
+      p->writable |= writable;
+      if (p->read_bytes >= read_bytes)
+        return true;
+    }
+
+  if (read_bytes > 0)
+    {
+      p->type = PAGE_FILE;
+      p->file = file;
+      p->file_ofs = ofs;
+      p->read_bytes = read_bytes;
+    }
+  return true;
+}
+
+/* Records that UPAGE is to be filled lazily with zeros.
+   Returns false if UPAGE is already in use or if memory
+   allocation fails. */
+bool
+page_add_zero (void *upage, bool writable)
+{
+  if (page_lookup (upage) != NULL)
+    return false;
+
+  struct page *p = page_create (upage, writable);
+  if (p == NULL)
+    return false;
+  p->type = PAGE_ZERO;
+  return true;
+}
+
+/* Records that UPAGE maps READ_BYTES bytes of FILE starting at
+   OFS, followed by zeros up to the end of the page.  The page is
+   read in lazily and, once modified, written back to FILE rather
+   than to swap.
+   Returns false if UPAGE is already in use or if memory
+   allocation fails. */
+bool
+page_add_mmap (void *upage, struct file *file, off_t ofs, size_t read_bytes)
+{
+  ASSERT (read_bytes <= PGSIZE);
+
+  if (page_lookup (upage) != NULL)
+    return false;
+
+  struct page *p = page_create (upage, true);
+  if (p == NULL)
+    return false;
+  p->type = PAGE_MMAP;
+  p->file = file;
+  p->file_ofs = ofs;
+  p->read_bytes = read_bytes;
+  return true;
+}
+
+/* Makes the current process's address space a copy-on-write
+   duplicate of PARENT's, which must not run meanwhile.  Resident
+   pages share their frames with PARENT, mapped read-only in both
+   processes until one of them writes; see page_copy_on_write().
+   Pages in swap share their slots.  Pages read from PARENT's
+   executable are read from EXEC_FILE instead, and memory mapped
+   pages are left to mmap_fork().
+   Returns false if memory allocation fails, in which case the
+   pages copied so far are released by page_table_destroy(). */
+bool
+page_table_fork (struct thread *parent, struct file *exec_file)
+{
+  struct hash_iterator i;
+
+  hash_first (&i, &parent->pages);
+  while (hash_next (&i))
+    {
+      struct page *pp = hash_entry (hash_cur (&i), struct page, elem);
+      if (pp->type == PAGE_MMAP)
+        {
+          page_sync (pp);
+          continue;
+        }
+
+      struct page *p = page_create (pp->upage, pp->writable);
+      if (p == NULL)
+        return false;
+
+      /* Lock the frame before copying PP, so that PP cannot be
+         evicted to a new swap slot in between.  A page without a
+         frame only changes when PARENT loads it. */
+      frame_lock (pp);
+
+      // apart from mappings, only the executable backs pages
+      p->type = pp->type;
+      p->file = pp->file != NULL ? exec_file : NULL;
+      p->file_ofs = pp->file_ofs;
+      p->read_bytes = pp->read_bytes;
+      p->swap_slot = swap_dup (pp->swap_slot);
+
+      if (pp->frame != NULL)
+        {
+          struct frame *f = pp->frame;
+          list_push_back (&f->pages, &p->frame_elem);
+          p->frame = f;
+          pagedir_set_writable (parent->pagedir, pp->upage, false);
+          bool mapped = page_map (p);
+          frame_unlock (f);
+          if (!mapped)
+            return false;
+        }
+    }
+  return true;
+}
+
+/* Removes the page containing UPAGE from the current thread's
+   address space.  A modified PAGE_MMAP page is written back to its
+   file first. */
+void
+page_remove (void *upage)
+{
+  struct page *p = page_lookup (upage);
+  if (p == NULL)
+    return;
+
+  hash_delete (&thread_current ()->pages, &p->elem);
+  page_discard (p);
+  free (p);
+}
+
+/* Brings in the page containing UADDR for the current thread and
+   maps it in the thread's page directory.
+   Returns false if UADDR has no supplemental page table entry or
+   if the page could not be loaded. */
+bool
+page_load (const void *uaddr)
+{
+  struct page *p = page_lookup (uaddr);
+  if (p == NULL || !page_pin (uaddr, false))
+    return false;
+  frame_unlock (p->frame);
+  return true;
+}
+
+/* Resolves a page fault at user address UADDR, where NOT_PRESENT
+   and WRITE describe the fault and ESP is the user stack pointer,
+   or a null pointer if it is not known: brings in the page, maps
+   the page of zeros, gives the page a private frame, or grows the
+   stack.  Without ESP, the stack is not grown.  Counts the fault
+   as minor or major depending on whether it read from a file or
+   swap.
+   Returns true if the faulting access can be retried, false if it
+   is invalid. */
+bool
+page_handle_fault (const void *uaddr, bool not_present, bool write,
+                   const void *esp)
+{
+  struct pagestats *stats = &thread_current ()->pagestats;
+  int64_t start = timer_ticks ();
+  uint64_t reads = stats->file_reads + stats->swap_ins;
+  bool handled;
+
+  if (!not_present)
+    handled = write && page_copy_on_write (uaddr);
+  else if (!write && page_map_zero (uaddr))
+    handled = true;
+  else if (page_load (uaddr))
+    {
+      page_fault_around (uaddr);
+      handled = true;
+    }
+  else
+    handled = esp != NULL && page_is_stack_access (uaddr, esp)
+              && page_grow_stack (uaddr);
+
+  if (handled)
+    {
+      if (stats->file_reads + stats->swap_ins != reads)
+        COUNT (major_faults, 1);
+      else
+        COUNT (minor_faults, 1);
+      COUNT (fault_ticks, timer_ticks () - start);
+    }
+  return handled;
+}
+
+/* Handles a read fault on the page containing UADDR if it is a
+   PAGE_ZERO page that has never been brought in, by mapping the
+   shared page of zeros read-only.  A private frame is allocated
+   only when the page is first written; see page_copy_on_write().
+   Returns false if the page is not such a page. */
+static bool
+page_map_zero (const void *uaddr)
+{
+  struct page *p = page_lookup (uaddr);
+
+  // only the owner brings pages in, so a missing frame stays missing
+  return p != NULL && p->type == PAGE_ZERO && p->frame == NULL
+         && pagedir_set_page (p->owner->pagedir, p->upage, zero_kpage, false);
+}
+
+/* Called after a fault brought in the page containing UADDR.  If
+   it is a page of a file, speculatively brings in the pages that
+   follow it in the same file, so that a program streaming through
+   its code or a mapped file takes one fault per window instead of
+   one per page.  The window starts closed and doubles with every
+   fault that continues a sequential scan, up to FAULT_AROUND_MAX
+   pages, and closes again on any other fault. */
+static void
+page_fault_around (const void *uaddr)
+{
+  struct thread *t = thread_current ();
+  uint8_t *upage = pg_round_down (uaddr);
+  struct page *p = page_lookup (upage);
+
+  if (p == NULL || (p->type != PAGE_FILE && p->type != PAGE_MMAP))
+    return;
+
+  if (upage != t->fault_next)
+    t->fault_window = 0;
+  else if (t->fault_window < FAULT_AROUND_MAX)
+    t->fault_window = t->fault_window > 0 ? t->fault_window * 2 : 1;
+
+  size_t i;
+  for (i = 1; i <= t->fault_window; i++)
+    {
+      struct page *next = page_lookup (upage + i * PGSIZE);
+      if (next == NULL || next->type != p->type || next->file != p->file
+          || next->file_ofs != p->file_ofs + (off_t)(i * PGSIZE)
+          || next->frame != NULL || !page_load (next->upage))
+        break;
+    }
+  t->fault_next = upage + i * PGSIZE;
+}
+
+/* Brings in the page containing UADDR like page_load() and locks
+   its frame, so it stays resident until page_unpin().  System
+   calls pin user buffers this way before taking the file system
+   lock, which eviction may need.
+   Returns false if UADDR has no page, if WILL_WRITE is true but
+   the page is read-only, or if the page could not be loaded. */
+bool
+page_pin (const void *uaddr, bool will_write)
+{
+  struct page *p = page_lookup (uaddr);
+  if (p == NULL || (will_write && !p->writable))
+    return false;
+
+  frame_lock (p);
+  if (p->frame == NULL)
+    {
+      // drop the page of zeros if it is mapped there
+      pagedir_clear_page (p->owner->pagedir, p->upage);
+      if (!page_in (p))
+        return false;
+      if (!page_map (p))
+        {
+          frame_free (p->frame);
+          p->frame = NULL;
+          return false;
+        }
+    }
+  else if (will_write && !page_unshare (p))
+    {
+      frame_unlock (p->frame);
+      return false;
+    }
+  return true;
+}
+
+/* Unlocks the frame of the page containing UADDR, which must have
+   been pinned with page_pin(). */
+void
+page_unpin (const void *uaddr)
+{
+  struct page *p = page_lookup (uaddr);
+  ASSERT (p != NULL && p->frame != NULL);
+  frame_unlock (p->frame);
+}
+
+/* Handles a write fault on the present page containing UADDR,
+   which is read-only in the page directory because its frame is,
+   or was, shared with a forked process, or because it is mapped
+   to the page of zeros.  Gives the page a private frame and maps
+   it writable.
+   Returns false if the page is read-only for the user or if no
+   frame is available. */
+static bool
+page_copy_on_write (const void *uaddr)
+{
+  struct page *p = page_lookup (uaddr);
+  if (p == NULL || !p->writable)
+    return false;
+
+  frame_lock (p);
+  if (p->frame == NULL)
+    {
+      // the page of zeros, or a frame evicted meanwhile
+      if (!page_pin (uaddr, true))
+        return false;
+      frame_unlock (p->frame);
+      return true;
+    }
+
+  bool success = page_unshare (p);
+  frame_unlock (p->frame);
+  return success;
+}
+
+/* Returns true if an access to UADDR, with the user stack pointer
+   at ESP, should extend the stack: UADDR lies within the stack
+   area at the top of user memory and no further below ESP than
+   PUSHA reaches. */
+bool
+page_is_stack_access (const void *uaddr, const void *esp)
+{
+  const uint8_t *addr = uaddr;
+  const uint8_t *bottom = (uint8_t *)PHYS_BASE - stack_page_limit * PGSIZE;
+
+  return is_user_vaddr (addr) && addr >= bottom
+         && addr + PUSHA_BYTES >= (const uint8_t *)esp;
+}
+
+/* Adds a zero page to the stack for UADDR and brings it in.
+   Returns false if the page is already in use or if it could not
+   be allocated. */
+bool
+page_grow_stack (const void *uaddr)
+{
+  void *upage = pg_round_down (uaddr);
+  return page_add_zero (upage, true) && page_load (upage);
+}
+
+/* Evicts the pages occupying the CNT frames in FRAMES, unmapping
+   them from their owners so the next access faults them back in.
+   A frame that is unchanged since it was filled is dropped, since
+   its pages can be rebuilt from their file, from zeros or from
+   their swap slot.  Modified frames are written to swap together,
+   and the pages that shared a frame then share its slot.  Frames
+   that cannot be written because swap is full stay resident.
+   On return, evicted frames have no pages left.
+   The frames must be locked by the current thread. */
+void
+page_out (struct frame **frames, size_t cnt)
+{
+  struct frame *dirty[SWAP_BATCH_PAGES];
+  void *kpages[SWAP_BATCH_PAGES];
+  size_t slots[SWAP_BATCH_PAGES];
+  size_t dirty_cnt = 0;
+  size_t i;
+  struct list_elem *e;
+
+  ASSERT (cnt <= SWAP_BATCH_PAGES);
+
+  for (i = 0; i < cnt; i++)
+    {
+      struct frame *f = frames[i];
+      bool is_dirty = f->dirty;
+
+      ASSERT (lock_held_by_current_thread (&f->lock));
+      ASSERT (!list_empty (&f->pages));
+
+      /* Unmap first, so no owner can dirty the frame after we
+         looked at the dirty bits. */
+      for (e = list_begin (&f->pages); e != list_end (&f->pages);
+           e = list_next (e))
+        {
+          struct page *p = list_entry (e, struct page, frame_elem);
+          uint32_t *pd = p->owner->pagedir;
+          pagedir_clear_page (pd, p->upage);
+          is_dirty |= pagedir_is_dirty (pd, p->upage);
+        }
+      if (!is_dirty)
+        {
+          page_drop_frame (f);
+          COUNT (evictions, 1);
+          continue;
+        }
+
+      /* Memory mapped files are their own backing store.  Their
+         pages are never shared. */
+      struct page *p = list_entry (list_front (&f->pages), struct page,
+                                   frame_elem);
+      if (p->type == PAGE_MMAP)
+        {
+          page_write_back (p);
+          page_drop_frame (f);
+          COUNT (evictions, 1);
+          continue;
+        }
+      dirty[dirty_cnt] = f;
+      kpages[dirty_cnt++] = f->kpage;
+    }
+
+  size_t written = swap_out (kpages, dirty_cnt, slots);
+  COUNT (swap_outs, written);
+  COUNT (evictions, written);
+  for (i = 0; i < dirty_cnt; i++)
+    {
+      struct frame *f = dirty[i];
+      for (e = list_begin (&f->pages); e != list_end (&f->pages);
+           e = list_next (e))
+        {
+          struct page *p = list_entry (e, struct page, frame_elem);
+          if (i < written)
+            {
+              /* An old copy in swap is stale now. */
+              if (p->type == PAGE_SWAP)
+                swap_free (p->swap_slot);
+              p->type = PAGE_SWAP;
+              p->swap_slot = e == list_begin (&f->pages) ? slots[i]
+                                                         : swap_dup (slots[i]);
+            }
+          else
+            page_map (p);
+        }
+
+      if (i < written)
+        page_drop_frame (f);
+      else
+        f->dirty = true; /* Remapping cleared the dirty bits. */
+    }
+}
+
+/* Allocates a frame for P and fills it.  A read-only page of the
+   executable shares the frame of another process running the same
+   program if there is one, and is offered for sharing otherwise.
+   On success P->frame is set and locked by the current thread. */
+static bool
+page_in (struct page *p)
+{
+  bool is_text = p->type == PAGE_FILE && !p->writable;
+  block_sector_t sector = 0;
+
+  if (is_text)
+    {
+      sector = inode_get_inumber (file_get_inode (p->file));
+      p->frame = frame_share_text (sector, p->file_ofs, p);
+      if (p->frame != NULL)
+        return true;
+    }
+
+  p->frame = frame_alloc_and_lock (p);
+  if (p->frame == NULL)
+    return false;
+
+  if (!page_read_in (p, p->frame->kpage))
+    {
+      frame_free (p->frame);
+      p->frame = NULL;
+      return false;
+    }
+  if (is_text)
+    frame_set_text (p->frame, sector, p->file_ofs);
+  return true;
+}
+
+/* Fills KPAGE with the initial contents of P. */
+static bool
+page_read_in (struct page *p, void *kpage)
+{
+  if (p->type == PAGE_ZERO)
+    {
+      memset (kpage, 0, PGSIZE);
+      return true;
+    }
+  if (p->type == PAGE_SWAP)
+    {
+      swap_in (p->swap_slot, kpage);
+      COUNT (swap_ins, 1);
+      return true;
+    }
+
+  off_t read = file_read_at (p->file, kpage, p->read_bytes, p->file_ofs);
+
+  COUNT (file_reads, 1);
+  if (read != (off_t)p->read_bytes)
+    return false;
+  memset ((uint8_t *)kpage + p->read_bytes, 0, PGSIZE - p->read_bytes);
+  return true;
+}
+
+/* Maps P's frame, which must be locked, in its owner's page
+   directory.  A shared frame is mapped read-only even for a
+   writable page, so that the first write faults and takes a
+   private copy. */
+static bool
+page_map (struct page *p)
+{
+  return pagedir_set_page (p->owner->pagedir, p->upage, p->frame->kpage,
+                           p->writable && !frame_is_shared (p->frame));
+}
+
+/* Unmaps P and removes it from the pages occupying its frame,
+   which stays locked.  If P modified the frame, the frame stays
+   dirty for the pages still sharing it. */
+static void
+page_detach (struct page *p)
+{
+  uint32_t *pd = p->owner->pagedir;
+
+  pagedir_clear_page (pd, p->upage);
+  if (pagedir_is_dirty (pd, p->upage))
+    p->frame->dirty = true;
+  list_remove (&p->frame_elem);
+  p->frame = NULL;
+}
+
+/* Makes P's locked frame writable for P, first moving P to a
+   private copy if the frame is shared.  On success P's frame,
+   possibly a new one, is locked by the current thread.  Returns
+   false if no frame is available for the copy, in which case P
+   keeps its shared frame. */
+static bool
+page_unshare (struct page *p)
+{
+  struct frame *shared = p->frame;
+  uint32_t *pd = p->owner->pagedir;
+
+  if (!frame_is_shared (shared))
+    {
+      pagedir_set_writable (pd, p->upage, true);
+      return true;
+    }
+
+  page_detach (p);
+  struct frame *f = frame_alloc_and_lock (p);
+  if (f == NULL)
+    {
+      list_push_back (&shared->pages, &p->frame_elem);
+      p->frame = shared;
+      page_map (p);
+      return false;
+    }
+
+  memcpy (f->kpage, shared->kpage, PGSIZE);
+  frame_unlock (shared);
+  p->frame = f;
+
+  // the page table is still there, so mapping cannot fail
+  page_map (p);
+  pagedir_set_dirty (pd, p->upage, true);
+  return true;
+}
+
+/* Writes P, a PAGE_MMAP page, back to its file if it is resident
+   and modified, and marks it clean. */
+static void
+page_sync (struct page *p)
+{
+  frame_lock (p);
+  if (p->frame == NULL)
+    return;
+
+  uint32_t *pd = p->owner->pagedir;
+  if (p->frame->dirty || pagedir_is_dirty (pd, p->upage))
+    {
+      page_write_back (p);
+      pagedir_set_dirty (pd, p->upage, false);
+      p->frame->dirty = false;
+    }
+  frame_unlock (p->frame);
+}
+
+/* Forgets the pages occupying F after they have been evicted. */
+static void
+page_drop_frame (struct frame *f)
+{
+  for (struct list_elem *e = list_begin (&f->pages); e != list_end (&f->pages);
+       e = list_next (e))
+    list_entry (e, struct page, frame_elem)->frame = NULL;
+  list_init (&f->pages);
+}
+
+/* Writes the first READ_BYTES bytes of P's frame back to its
+   file.  P's frame must be locked by the current thread. */
+static void
+page_write_back (struct page *p)
+{
+  ASSERT (p->type == PAGE_MMAP);
+  ASSERT (lock_held_by_current_thread (&p->frame->lock));
+
+  file_write_at (p->file, p->frame->kpage, p->read_bytes, p->file_ofs);
+  COUNT (writebacks, 1);
+}
+
+/* Releases everything P holds outside of its table entry: its
+   mapping and its share of its frame, after writing back a
+   modified PAGE_MMAP page, and its share of its swap slot. */
+static void
+page_discard (struct page *p)
+{
+  frame_lock (p);
+  if (p->frame != NULL)
+    {
+      struct frame *f = p->frame;
+      uint32_t *pd = p->owner->pagedir;
+      pagedir_clear_page (pd, p->upage);
+      if (p->type == PAGE_MMAP
+          && (f->dirty || pagedir_is_dirty (pd, p->upage)))
+        page_write_back (p);
+
+      page_detach (p);
+      if (list_empty (&f->pages))
+        frame_free (f);
+      else
+        frame_unlock (f);
+    }
+  else
+    {
+      // pagedir_destroy() must not free the page of zeros
+      pagedir_clear_page (p->owner->pagedir, p->upage);
+    }
+  if (p->type == PAGE_SWAP)
+    swap_free (p->swap_slot);
+}
+
+/* Allocates a new entry for UPAGE and inserts it into the current
+   thread's table.  Returns NULL if memory allocation fails. */
+static struct page *
+page_create (void *upage, bool writable)
+{
+  ASSERT (pg_ofs (upage) == 0);
+  ASSERT (is_user_vaddr (upage));
+
+  struct page *p = malloc (sizeof *p);
+  if (p == NULL)
+    return NULL;
+
+  p->upage = upage;
+  p->writable = writable;
+  p->type = PAGE_ZERO;
+  p->file = NULL;
+  p->file_ofs = 0;
+  p->read_bytes = 0;
+  p->swap_slot = SWAP_SLOT_NONE;
+  p->owner = thread_current ();
+  p->frame = NULL;
+  hash_insert (&thread_current ()->pages, &p->elem);
+  return p;
+}
+
+static void
+page_free (struct hash_elem *e, void *aux UNUSED)
+{
+  struct page *p = hash_entry (e, struct page, elem);
+  page_discard (p);
+  free (p);
+}
+
+static unsigned
+page_hash (const struct hash_elem *e, void *aux UNUSED)
+{
+  const struct page *p = hash_entry (e, struct page, elem);
+  return hash_bytes (&p->upage, sizeof p->upage);
+}
+
+static bool
+page_less (const struct hash_elem *a, const struct hash_elem *b,
+           void *aux UNUSED)
+{
+  return hash_entry (a, struct page, elem)->upage
+         < hash_entry (b, struct page, elem)->upage;
+}
@@ -0,0 +1,85 @@
+#ifndef VM_PAGE_H
+#define VM_PAGE_H
+
+#include "filesys/off_t.h"
+#include <hash.h>
+#include <list.h>
+#include <pagestats.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "threads/vaddr.h"
+
+/* Where the contents of a user page come from the first time it
+   is touched. */
+enum page_type
+{
+  PAGE_FILE, /* Read from a file, rest of the page zeroed. */
+  PAGE_ZERO, /* All zeros. */
+  PAGE_SWAP, /* Read from the page's swap slot. */
+  PAGE_MMAP  /* Like PAGE_FILE, but changes are written back to the file. */
+};
+
+/* Supplemental page table entry.
+   Describes one page of a process's user virtual address space,
+   whether or not it is currently resident in memory. */
+struct page
+{
+  void *upage;         /* User virtual address of the page. */
+  enum page_type type; /* How to bring the page in. */
+  bool writable;       /* Whether the user may write the page. */
+
+  /* Only meaningful for PAGE_FILE and PAGE_MMAP. */
+  struct file *file;   /* File to read the page from. */
+  off_t file_ofs;      /* Offset in FILE of the first byte. */
+  size_t read_bytes;   /* Bytes to read, the rest is zeroed. */
+
+  /* Only meaningful for PAGE_SWAP.  The slot is kept while the
+     page is resident and clean, so it can be dropped on eviction. */
+  size_t swap_slot;    /* Swap slot, or SWAP_SLOT_NONE. */
+
+  struct thread *owner; /* Process whose address space holds the page. */
+  struct frame *frame;  /* Frame holding the page, NULL if not resident. */
+  struct list_elem frame_elem; /* Element in frame's `pages' list. */
+  struct hash_elem elem; /* Element in thread's `pages' table. */
+};
+
+/* Default maximum number of pages in a process's stack: 8 MB. */
+#define STACK_PAGE_LIMIT 2048
+
+/* Largest stack limit accepted: the stack may reach down to where
+   user programs are loaded, at 0x08048000. */
+#define STACK_PAGE_LIMIT_MAX (((uintptr_t) PHYS_BASE - 0x08048000) / PGSIZE)
+
+/* Maximum number of pages in a process's stack. */
+extern size_t stack_page_limit;
+
+struct frame;
+struct thread;
+
+void page_init (void);
+void page_get_stats (struct pagestats *stats, bool system);
+void page_print_stats (void);
+
+bool page_table_init (struct hash *pages);
+void page_table_destroy (struct hash *pages);
+bool page_table_fork (struct thread *parent, struct file *exec_file);
+
+struct page *page_lookup (const void *uaddr);
+bool page_add_file (void *upage, struct file *file, off_t ofs,
+                    size_t read_bytes, bool writable);
+bool page_add_zero (void *upage, bool writable);
+bool page_add_mmap (void *upage, struct file *file, off_t ofs,
+                    size_t read_bytes);
+void page_remove (void *upage);
+bool page_handle_fault (const void *uaddr, bool not_present, bool write,
+                        const void *esp);
+bool page_load (const void *uaddr);
+bool page_pin (const void *uaddr, bool will_write);
+void page_unpin (const void *uaddr);
+bool page_is_stack_access (const void *uaddr, const void *esp);
+bool page_grow_stack (const void *uaddr);
+
+void page_out (struct frame **frames, size_t cnt);
+
+#endif /* vm/page.h */
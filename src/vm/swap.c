@@ -0,0 +1,147 @@
+#include "vm/swap.h"
+#include "devices/block.h"
+#include "threads/malloc.h"
+#include "threads/synch.h"
+#include "threads/vaddr.h"
+#include <bitmap.h>
+#include <debug.h>
+#include <stdio.h>
+
+/* Number of sectors in one swap slot. */
+#define PAGE_SECTORS (PGSIZE / BLOCK_SECTOR_SIZE)
+
+static struct block *swap_device;
+
+/* One bit per slot, true if the slot is in use. */
+static struct bitmap *swap_slots;
+
+/* Number of pages referring to each slot in use.  Pages of a
+   forked process share their parent's slots. */
+static unsigned short *slot_refs;
+
+static struct lock swap_lock;
+
+static void write_slots (size_t first, void **kpages, size_t cnt);
+
+/* Sets up swap on the BLOCK_SWAP device.
+   Without a swap device, swap_out() always fails and only clean
+   pages can be evicted. */
+void
+swap_init (void)
+{
+  size_t slot_cnt = 0;
+
+  lock_init (&swap_lock);
+  swap_device = block_get_role (BLOCK_SWAP);
+  if (swap_device != NULL)
+    slot_cnt = block_size (swap_device) / PAGE_SECTORS;
+  else
+    printf ("swap: no swap device, swapping disabled\n");
+
+  swap_slots = bitmap_create (slot_cnt);
+  slot_refs = calloc (slot_cnt, sizeof *slot_refs);
+  if (swap_slots == NULL || (slot_refs == NULL && slot_cnt > 0))
+    PANIC ("out of memory allocating swap bitmap");
+}
+
+/* Writes the CNT pages at KPAGES, at most SWAP_BATCH_PAGES, to
+   swap, in runs of adjacent slots, each written with one request,
+   so that a batch of evicted pages reaches the disk as one
+   sequential write unless swap is fragmented.  Stores the slot of each page written in
+   SLOTS, with one reference to it.
+   Returns the number of pages written, which is less than CNT
+   only if swap is full; those written are a prefix of KPAGES. */
+size_t
+swap_out (void **kpages, size_t cnt, size_t *slots)
+{
+  size_t done = 0;
+  size_t run = cnt;
+
+  while (done < cnt && run > 0)
+    {
+      if (run > cnt - done)
+        run = cnt - done;
+
+      lock_acquire (&swap_lock);
+      size_t first = bitmap_scan_and_flip (swap_slots, 0, run, false);
+      for (size_t i = 0; first != BITMAP_ERROR && i < run; i++)
+        slot_refs[first + i] = 1;
+      lock_release (&swap_lock);
+
+      /* Settle for shorter runs when swap is fragmented. */
+      if (first == BITMAP_ERROR)
+        {
+          run /= 2;
+          continue;
+        }
+
+      write_slots (first, kpages + done, run);
+      for (size_t i = 0; i < run; i++, done++)
+        slots[done] = first + i;
+    }
+  return done;
+}
+
+/* Reads SLOT into KPAGE.
+   The slot stays allocated, so that the page can be evicted again
+   without rewriting it as long as it is not modified. */
+void
+swap_in (size_t slot, void *kpage)
+{
+  ASSERT (slot != SWAP_SLOT_NONE);
+
+  void *buffers[PAGE_SECTORS];
+
+  for (size_t i = 0; i < PAGE_SECTORS; i++)
+    buffers[i] = (uint8_t *)kpage + i * BLOCK_SECTOR_SIZE;
+  block_read_multiple (swap_device, slot * PAGE_SECTORS, PAGE_SECTORS,
+                       buffers);
+}
+
+/* Adds a reference to SLOT, for a page that shares it with the
+   page that was swapped out.  Returns SLOT, which may be
+   SWAP_SLOT_NONE. */
+size_t
+swap_dup (size_t slot)
+{
+  if (slot == SWAP_SLOT_NONE)
+    return slot;
+
+  lock_acquire (&swap_lock);
+  ASSERT (bitmap_test (swap_slots, slot));
+  ASSERT (slot_refs[slot] < (unsigned short)-1);
+  slot_refs[slot]++;
+  lock_release (&swap_lock);
+  return slot;
+}
+
+/* Drops a reference to SLOT, making it available for reuse once
+   no page refers to it.  Does nothing for SWAP_SLOT_NONE. */
+void
+swap_free (size_t slot)
+{
+  if (slot == SWAP_SLOT_NONE)
+    return;
+
+  lock_acquire (&swap_lock);
+  ASSERT (bitmap_test (swap_slots, slot));
+  if (--slot_refs[slot] == 0)
+    bitmap_reset (swap_slots, slot);
+  lock_release (&swap_lock);
+}
+
+/* Writes the CNT pages at KPAGES, at most SWAP_BATCH_PAGES, to
+   the adjacent slots starting at FIRST, with one request. */
+static void
+write_slots (size_t first, void **kpages, size_t cnt)
+{
+  const void *buffers[SWAP_BATCH_PAGES * PAGE_SECTORS];
+
+  ASSERT (cnt <= SWAP_BATCH_PAGES);
+
+  for (size_t i = 0; i < cnt * PAGE_SECTORS; i++)
+    buffers[i] = (const uint8_t *)kpages[i / PAGE_SECTORS]
+                 + i % PAGE_SECTORS * BLOCK_SECTOR_SIZE;
+  block_write_multiple (swap_device, first * PAGE_SECTORS,
+                        cnt * PAGE_SECTORS, buffers);
+}
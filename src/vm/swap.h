@@ -0,0 +1,18 @@
+#ifndef VM_SWAP_H
+#define VM_SWAP_H
+
+#include <stddef.h>
+
+/* Marks a page that has no swap slot. */
+#define SWAP_SLOT_NONE ((size_t)-1)
+
+/* Most pages written out together by a single eviction. */
+#define SWAP_BATCH_PAGES 8
+
+void swap_init (void);
+size_t swap_out (void **kpages, size_t cnt, size_t *slots);
+void swap_in (size_t slot, void *kpage);
+size_t swap_dup (size_t slot);
+void swap_free (size_t slot);
+
+#endif /* vm/swap.h */